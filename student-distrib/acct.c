@@ -0,0 +1,117 @@
+#include "acct.h"
+#include "clock.h"
+#include "lib.h"
+#include "syscall.h"
+
+/* acct_init
+ * Description: Starts a new process' CPU accounting from zero
+ * Inputs: pcb -- process being created
+ * Outputs: none
+ * Return Value: none
+ * Function: Clears the counters and starts the clock now
+ */
+void acct_init(Pcb* const pcb) {
+  pcb->utime = 0;
+  pcb->stime = 0;
+  pcb->nr_switches = 0;
+  pcb->nr_syscalls = 0;
+  pcb->acct_tsc = rdtsc();
+}
+
+/* acct_charge
+ * Description: Charges the time since the last accounting event to a process
+ * Inputs: pcb -- process that has been running
+ *         user -- 1 if it was running in user mode, 0 if in the kernel
+ * Outputs: none
+ * Return Value: none
+ * Function: Called on every mode change: syscall entry and exit, and each timer tick (which is
+ *           where a process running in user mode gets interrupted). Time in other interrupts is
+ *           charged to whoever they interrupted.
+ */
+void acct_charge(Pcb* const pcb, u8 const user) {
+  u64 const now = rdtsc();
+
+  if (user)
+    pcb->utime += now - pcb->acct_tsc;
+  else
+    pcb->stime += now - pcb->acct_tsc;
+
+  pcb->acct_tsc = now;
+}
+
+/* acct_switch
+ * Description: Accounts for a context switch
+ * Inputs: prev -- process giving up the CPU, always in the kernel by now
+ *         next -- process about to run, or NULL if it starts out fresh through execute
+ * Outputs: none
+ * Return Value: none
+ * Function: Charges prev up to now and restarts next's clock, so the time next spent switched out
+ *           isn't charged to it
+ */
+void acct_switch(Pcb* const prev, Pcb* const next) {
+  acct_charge(prev, 0);
+  ++prev->nr_switches;
+
+  if (next)
+    next->acct_tsc = prev->acct_tsc;
+}
+
+/* acct_resume
+ * Description: Restarts a process' clock without charging it
+ * Inputs: pcb -- process that is about to run again
+ * Outputs: none
+ * Return Value: none
+ * Function: For a parent resuming in execute after its child halts; the child's run isn't the
+ *           parent's time
+ */
+void acct_resume(Pcb* const pcb) { pcb->acct_tsc = rdtsc(); }
+
+/* getprocs
+ * Description: Takes a snapshot of every process' CPU usage
+ * Inputs: buf -- table to fill in, one entry per process
+ *         n -- number of entries buf has room for
+ * Outputs: none
+ * Return Value: number of entries filled in, -1 on failure
+ * Function: Times are converted to microseconds and wrap, so callers should only look at the
+ *           difference between two snapshots. The caller's own time is charged up to now first.
+ */
+i32 getprocs(ProcStat* const buf, i32 const n) {
+  Pcb* pcb;
+  u32 pid, flags;
+  i32 cnt = 0;
+
+  if (!buf || n <= 0 || bad_userspace_addr(buf, MIN(n, MAX_PID_COUNT) * (i32)sizeof(*buf)))
+    return -1;
+
+  cli_and_save(flags);
+
+  acct_charge(get_current_pcb(), 0);
+
+  for (pid = 0; pid < MAX_PID_COUNT && cnt < n; ++pid) {
+    ProcStat* const ps = &buf[cnt];
+
+    if (!(pcb = get_task(pid)))
+      continue;
+
+    ps->pid = pid;
+    ps->parent_pid = pcb->parent_pid;
+    ps->state = pcb->state;
+    ps->term = pcb->term;
+    ps->prio = pcb->prio;
+    ps->nice = pcb->nice;
+    ps->utime_us = cycles_to_us(pcb->utime);
+    ps->stime_us = cycles_to_us(pcb->stime);
+    ps->nr_switches = pcb->nr_switches;
+    ps->nr_syscalls = pcb->nr_syscalls;
+
+    /* argv[0] is the program name, split off from its arguments by execute */
+    strncpy(ps->name, pcb->argv[0], PROC_NAME_LEN - 1);
+    ps->name[PROC_NAME_LEN - 1] = '\0';
+
+    ++cnt;
+  }
+
+  restore_flags(flags);
+
+  return cnt;
+}
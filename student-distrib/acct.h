@@ -0,0 +1,33 @@
+#ifndef ACCT_H
+#define ACCT_H
+
+#include "types.h"
+
+enum {
+  PROC_NAME_LEN = 32 /* Same as a filesystem name, so any program's name fits */
+};
+
+/* One process' entry in the table getprocs returns; mirrored by struct ece391_procstat */
+typedef struct ProcStat {
+  u32 pid;
+  i32 parent_pid;
+  u8 state;
+  u8 term;
+  u8 prio;
+  u8 nice;
+  u32 utime_us; /* Time spent in user mode, modulo 2^32 */
+  u32 stime_us; /* Time spent in the kernel on the process' behalf, modulo 2^32 */
+  u32 nr_switches;
+  u32 nr_syscalls;
+  i8 name[PROC_NAME_LEN];
+} ProcStat;
+
+struct Pcb;
+
+void acct_init(struct Pcb* pcb);
+void acct_charge(struct Pcb* pcb, u8 user);
+void acct_switch(struct Pcb* prev, struct Pcb* next);
+void acct_resume(struct Pcb* pcb);
+i32 getprocs(ProcStat* buf, i32 n);
+
+#endif
@@ -0,0 +1,386 @@
+#include "apic.h"
+#include "clock.h"
+#include "i8259.h"
+#include "idt.h"
+#include "lib.h"
+#include "pit.h"
+
+/* Local APIC registers, mapped by init_paging. NULL until the MP tables say there is one. */
+static u8 volatile* lapic;
+
+/* First I/O APIC's registers, NULL without one */
+static u8 volatile* ioapic;
+
+/* I/O APIC pin each ISA IRQ is wired to. Identity unless the MP table overrides it; the PIT is
+ * usually on pin 2. */
+static u8 isa_pin[ISA_IRQ_CNT] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+/* Polarity and trigger mode bits of each ISA IRQ's redirection entry. ISA interrupts are edge
+ * triggered and active high unless the MP table says otherwise. */
+static u32 isa_redir[ISA_IRQ_CNT];
+
+/* Whether device interrupts go through the I/O APIC and the tick comes from the local APIC timer */
+static u8 apic_irqs;
+
+/* Local APIC timer counts per scheduler tick */
+static u32 lapic_tick_count;
+
+/* APIC ID the I/O APIC delivers to */
+static u32 ioapic_dest;
+
+static u32 lapic_read(u32 reg);
+static void lapic_write(u32 reg, u32 val);
+static void lapic_wait_icr(void);
+static u32 ioapic_read(u32 reg);
+static void ioapic_write(u32 reg, u32 val);
+static u32 lapic_timer_calibrate(void);
+
+/* lapic_read
+ * Description: Reads a local APIC register
+ * Inputs: reg -- byte offset of the register
+ * Outputs: none
+ * Return Value: the register's value
+ * Function: Registers must be accessed as whole dwords
+ */
+static u32 lapic_read(u32 const reg) { return *(u32 volatile*)(lapic + reg); }
+
+/* lapic_write
+ * Description: Writes a local APIC register
+ * Inputs: reg -- byte offset of the register
+ *         val -- value to write
+ * Outputs: none
+ * Return Value: none
+ * Function: Registers must be accessed as whole dwords
+ */
+static void lapic_write(u32 const reg, u32 const val) { *(u32 volatile*)(lapic + reg) = val; }
+
+/* lapic_wait_icr
+ * Description: Waits for the last IPI to be sent
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Spins on the ICR's delivery status bit
+ */
+static void lapic_wait_icr(void) {
+  while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING)
+    asm volatile("pause");
+}
+
+/* ioapic_read
+ * Description: Reads an I/O APIC register
+ * Inputs: reg -- register index
+ * Outputs: none
+ * Return Value: the register's value
+ * Function: Selects the register, then reads it through the window
+ */
+static u32 ioapic_read(u32 const reg) {
+  *(u32 volatile*)(ioapic + IOAPIC_REGSEL) = reg;
+  return *(u32 volatile*)(ioapic + IOAPIC_WIN);
+}
+
+/* ioapic_write
+ * Description: Writes an I/O APIC register
+ * Inputs: reg -- register index
+ *         val -- value to write
+ * Outputs: none
+ * Return Value: none
+ * Function: Selects the register, then writes it through the window
+ */
+static void ioapic_write(u32 const reg, u32 const val) {
+  *(u32 volatile*)(ioapic + IOAPIC_REGSEL) = reg;
+  *(u32 volatile*)(ioapic + IOAPIC_WIN) = val;
+}
+
+/* set_lapic_base
+ * Description: Records where the local APIC's registers are
+ * Inputs: addr -- physical address from the MP configuration table
+ * Outputs: none
+ * Return Value: none
+ * Function: The address has to fall inside the 4MB page init_paging maps at APIC_MMIO_BASE
+ */
+void set_lapic_base(u32 const addr) {
+  if (addr >= APIC_MMIO_BASE && addr - APIC_MMIO_BASE < APIC_MMIO_SIZE)
+    lapic = (u8 volatile*)addr;
+}
+
+/* lapic_present
+ * Description: Checks whether the local APIC can be used
+ * Inputs: none
+ * Outputs: none
+ * Return Value: 1 if it is mapped, 0 otherwise
+ * Function: Getter for the base set by set_lapic_base
+ */
+u8 lapic_present(void) { return lapic != NULL; }
+
+/* init_lapic
+ * Description: Software-enables this CPU's local APIC
+ * Inputs: bsp -- 1 on the bootstrap processor
+ * Outputs: none
+ * Return Value: none
+ * Function: The bootstrap processor keeps taking the 8259's interrupts through LINT0 in
+ *           virtual wire mode; the other processors mask it so the 8259 only talks to one CPU.
+ *           LINT1 carries NMIs everywhere. The bootstrap processor also calibrates the timer,
+ *           before the other processors start, so they can start theirs straight away.
+ * Reference: Intel SDM Vol. 3, 10.4.3 and MP Spec 1.4, 3.6.2.2
+ */
+void init_lapic(u8 const bsp) {
+  if (!lapic)
+    return;
+
+  lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | IDT_SPURIOUS);
+  lapic_write(LAPIC_LVT_LINT0, bsp ? LAPIC_DM_EXTINT : (LAPIC_DM_EXTINT | LAPIC_LVT_MASKED));
+  lapic_write(LAPIC_LVT_LINT1, LAPIC_DM_NMI);
+
+  if (bsp)
+    lapic_tick_count = lapic_timer_calibrate();
+}
+
+/* lapic_id
+ * Description: Gets the APIC ID of the CPU we're running on
+ * Inputs: none
+ * Outputs: none
+ * Return Value: the APIC ID, or 0 without a local APIC
+ * Function: Reads the ID register
+ */
+u32 lapic_id(void) { return lapic ? lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT : 0; }
+
+/* lapic_send_init
+ * Description: Sends an INIT IPI
+ * Inputs: apic_id -- CPU to reset
+ * Outputs: none
+ * Return Value: none
+ * Function: Puts the target into wait-for-SIPI
+ */
+void lapic_send_init(u32 const apic_id) {
+  lapic_write(LAPIC_ICR_HIGH, apic_id << LAPIC_ICR_DEST_SHIFT);
+  lapic_write(LAPIC_ICR_LOW, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+  lapic_wait_icr();
+}
+
+/* lapic_send_startup
+ * Description: Sends a startup IPI
+ * Inputs: apic_id -- CPU to start
+ *         addr -- 4KB-aligned physical address below 1MB to start it at, in real mode
+ * Outputs: none
+ * Return Value: none
+ * Function: The vector field holds the page number of the start address
+ */
+void lapic_send_startup(u32 const apic_id, u32 const addr) {
+  lapic_write(LAPIC_ICR_HIGH, apic_id << LAPIC_ICR_DEST_SHIFT);
+  lapic_write(LAPIC_ICR_LOW, LAPIC_ICR_STARTUP | (addr >> LAPIC_SIPI_PAGE_SHIFT));
+  lapic_wait_icr();
+}
+
+/* irqh_spurious
+ * Description: Spurious interrupt handler
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: The local APIC sends these when an interrupt goes away before it's acknowledged.
+ *           They must not get an EOI.
+ */
+void irqh_spurious(void) {}
+
+/* lapic_eoi
+ * Description: Acknowledges the interrupt being serviced
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: A single store to the EOI register, instead of the 8259's port writes
+ */
+void lapic_eoi(void) { lapic_write(LAPIC_EOI, 0); }
+
+/* lapic_timer_periodic
+ * Description: Makes the local APIC timer interrupt at a fixed rate
+ * Inputs: count -- timer counts between interrupts
+ * Outputs: none
+ * Return Value: none
+ * Function: Interrupts on the PIT's vector, so irqh_pit handles it either way
+ */
+void lapic_timer_periodic(u32 const count) {
+  lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+  lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | IDT_PIT);
+  lapic_write(LAPIC_TIMER_INIT, count);
+}
+
+/* lapic_timer_ap
+ * Description: Starts an application processor's local APIC timer
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Periodic at the scheduler tick like the bootstrap processor's, but on IDT_AP_TIMER,
+ *           since the processor doesn't run the scheduler. Does nothing if the timer couldn't be
+ *           calibrated.
+ */
+void lapic_timer_ap(void) {
+  if (!lapic_tick_count)
+    return;
+
+  lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+  lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | IDT_AP_TIMER);
+  lapic_write(LAPIC_TIMER_INIT, lapic_tick_count);
+}
+
+/* lapic_timer_oneshot
+ * Description: Makes the local APIC timer interrupt once
+ * Inputs: count -- timer counts until the interrupt
+ * Outputs: none
+ * Return Value: none
+ * Function: The current count stops at zero once it goes off
+ */
+void lapic_timer_oneshot(u32 const count) {
+  lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+  lapic_write(LAPIC_LVT_TIMER, IDT_PIT);
+  lapic_write(LAPIC_TIMER_INIT, count);
+}
+
+/* lapic_timer_remaining
+ * Description: Reads how many counts the local APIC timer has left
+ * Inputs: none
+ * Outputs: none
+ * Return Value: current count, 0 once a one-shot went off
+ * Function: Reads the current count register
+ */
+u32 lapic_timer_remaining(void) { return lapic_read(LAPIC_TIMER_CUR); }
+
+/* get_lapic_tick_count
+ * Description: Gets the local APIC timer's counts per scheduler tick
+ * Inputs: none
+ * Outputs: none
+ * Return Value: counts per tick, 0 until init_apic_irqs calibrates it
+ * Function: Getter
+ */
+u32 get_lapic_tick_count(void) { return lapic_tick_count; }
+
+/* lapic_timer_calibrate
+ * Description: Measures the local APIC timer against the TSC clock
+ * Inputs: none
+ * Outputs: none
+ * Return Value: timer counts per scheduler tick
+ * Function: Lets the timer count down from the top, masked, for LAPIC_CALIBRATE_US. The bus clock
+ *           is the same on every CPU, so one measurement does for all of them.
+ */
+static u32 lapic_timer_calibrate(void) {
+  u32 counted;
+
+  lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+  lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | IDT_PIT);
+  lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+
+  clock_delay_us(LAPIC_CALIBRATE_US);
+
+  counted = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+  lapic_write(LAPIC_TIMER_INIT, 0);
+
+  return counted / (LAPIC_CALIBRATE_US / (US_IN_SEC / PIT_HZ));
+}
+
+/* set_ioapic_base
+ * Description: Records where the I/O APIC's registers are
+ * Inputs: addr -- physical address from the MP configuration table
+ * Outputs: none
+ * Return Value: none
+ * Function: The address has to fall inside the 4MB page init_paging maps at APIC_MMIO_BASE
+ */
+void set_ioapic_base(u32 const addr) {
+  if (addr >= APIC_MMIO_BASE && addr - APIC_MMIO_BASE < APIC_MMIO_SIZE)
+    ioapic = (u8 volatile*)addr;
+}
+
+/* ioapic_route_isa
+ * Description: Records which I/O APIC pin an ISA IRQ is wired to, and how
+ * Inputs: irq -- ISA IRQ
+ *         pin -- I/O APIC input
+ *         redir -- IOAPIC_ACTIVE_LOW and IOAPIC_LEVEL as the source needs them
+ * Outputs: none
+ * Return Value: none
+ * Function: Filled in from the MP table's interrupt assignment entries
+ */
+void ioapic_route_isa(u32 const irq, u32 const pin, u32 const redir) {
+  if (irq >= ISA_IRQ_CNT)
+    return;
+
+  isa_pin[irq] = (u8)pin;
+  isa_redir[irq] = redir & (IOAPIC_ACTIVE_LOW | IOAPIC_LEVEL);
+}
+
+/* ioapic_enable_irq
+ * Description: Unmasks an ISA IRQ at the I/O APIC
+ * Inputs: irq -- ISA IRQ
+ * Outputs: none
+ * Return Value: none
+ * Function: Delivered to the bootstrap processor on the vector the 8259 would have used, with
+ *           the polarity and trigger mode the MP table gave. The local APIC's EOI also clears a
+ *           level-triggered entry's remote IRR.
+ */
+void ioapic_enable_irq(u32 const irq) {
+  u32 const reg = IOAPIC_REDTBL + 2 * isa_pin[irq];
+
+  ioapic_write(reg + 1, ioapic_dest << IOAPIC_DEST_SHIFT);
+  ioapic_write(reg, isa_redir[irq] | (IOAPIC_VECTOR_BASE + irq));
+}
+
+/* ioapic_disable_irq
+ * Description: Masks an ISA IRQ at the I/O APIC
+ * Inputs: irq -- ISA IRQ
+ * Outputs: none
+ * Return Value: none
+ * Function: Leaves the rest of the redirection entry alone
+ */
+void ioapic_disable_irq(u32 const irq) {
+  u32 const reg = IOAPIC_REDTBL + 2 * isa_pin[irq];
+
+  ioapic_write(reg, ioapic_read(reg) | IOAPIC_MASKED);
+}
+
+/* ioapic_read_redir
+ * Description: Reads the low half of an ISA IRQ's redirection entry
+ * Inputs: irq -- ISA IRQ
+ * Outputs: none
+ * Return Value: vector, delivery and mask bits of the entry
+ * Function: For checking the routing
+ */
+u32 ioapic_read_redir(u32 const irq) { return ioapic_read(IOAPIC_REDTBL + 2 * isa_pin[irq]); }
+
+/* apic_irqs_enabled
+ * Description: Checks which interrupt controller is in charge
+ * Inputs: none
+ * Outputs: none
+ * Return Value: 1 if the APICs deliver interrupts, 0 if the 8259 still does
+ * Function: Getter
+ */
+u8 apic_irqs_enabled(void) { return apic_irqs; }
+
+/* init_apic_irqs
+ * Description: Moves interrupt delivery from the 8259 to the APICs
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Masks every I/O APIC pin, then hands the IRQs the 8259 had enabled over to the
+ *           I/O APIC. The PIT's IRQ isn't moved since the local APIC timer replaces it. Without
+ *           both APICs, or if init_lapic couldn't calibrate the timer, everything stays on the
+ *           8259. Must run after init_smp.
+ */
+void init_apic_irqs(void) {
+  u32 flags, pins, i;
+
+  if (!lapic || !ioapic || !lapic_tick_count)
+    return;
+
+  cli_and_save(flags);
+
+  ioapic_dest = lapic_id();
+
+  pins = ((ioapic_read(IOAPIC_VER) >> IOAPIC_MAX_REDIR_SHIFT) & 0xFF) + 1;
+  for (i = 0; i < pins; ++i)
+    ioapic_write(IOAPIC_REDTBL + 2 * i, IOAPIC_MASKED);
+
+  /* Any one-shot has to finish on the PIT before the tick moves */
+  tick_nohz_stop();
+
+  i8259_to_ioapic();
+  apic_irqs = 1;
+  lapic_timer_periodic(lapic_tick_count);
+
+  restore_flags(flags);
+}
@@ -0,0 +1,77 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include "types.h"
+
+enum {
+  APIC_MMIO_BASE = 0xFEC00000, /* 4MB page holding both the I/O APIC and the local APIC */
+  APIC_MMIO_SIZE = 0x400000,
+
+  /* Local APIC registers, as byte offsets from its base */
+  LAPIC_ID = 0x020,
+  LAPIC_EOI = 0x0B0,
+  LAPIC_SVR = 0x0F0,
+  LAPIC_ICR_LOW = 0x300,
+  LAPIC_ICR_HIGH = 0x310,
+  LAPIC_LVT_TIMER = 0x320,
+  LAPIC_LVT_LINT0 = 0x350,
+  LAPIC_LVT_LINT1 = 0x360,
+
+  LAPIC_ID_SHIFT = 24,
+  LAPIC_SVR_ENABLE = 1 << 8,
+  LAPIC_LVT_MASKED = 1 << 16,
+  LAPIC_DM_NMI = 0x400,
+  LAPIC_DM_EXTINT = 0x700,
+
+  /* Interrupt command register */
+  LAPIC_ICR_INIT = 0x500,
+  LAPIC_ICR_STARTUP = 0x600,
+  LAPIC_ICR_PENDING = 1 << 12,
+  LAPIC_ICR_ASSERT = 1 << 14,
+  LAPIC_ICR_DEST_SHIFT = 24,
+  LAPIC_SIPI_PAGE_SHIFT = 12,
+
+  /* Timer */
+  LAPIC_TIMER_INIT = 0x380,
+  LAPIC_TIMER_CUR = 0x390,
+  LAPIC_TIMER_DIV = 0x3E0,
+  LAPIC_TIMER_DIV_16 = 0x3,
+  LAPIC_TIMER_PERIODIC = 1 << 17,
+  LAPIC_CALIBRATE_US = 10000,
+
+  /* I/O APIC: an index register and a data window */
+  IOAPIC_REGSEL = 0x00,
+  IOAPIC_WIN = 0x10,
+  IOAPIC_VER = 0x01,
+  IOAPIC_REDTBL = 0x10, /* Two registers per pin: low dword, then high */
+  IOAPIC_MAX_REDIR_SHIFT = 16,
+  IOAPIC_ACTIVE_LOW = 1 << 13,
+  IOAPIC_LEVEL = 1 << 15,
+  IOAPIC_MASKED = 1 << 16,
+  IOAPIC_DEST_SHIFT = 24,
+  IOAPIC_VECTOR_BASE = 0x20, /* Same vectors the 8259 uses, so the IDT doesn't change */
+  ISA_IRQ_CNT = 16
+};
+
+void init_lapic(u8 bsp);
+u8 lapic_present(void);
+void set_lapic_base(u32 addr);
+u32 lapic_id(void);
+void lapic_send_init(u32 apic_id);
+void lapic_send_startup(u32 apic_id, u32 addr);
+void irqh_spurious(void);
+void lapic_eoi(void);
+void lapic_timer_periodic(u32 count);
+void lapic_timer_ap(void);
+void lapic_timer_oneshot(u32 count);
+u32 lapic_timer_remaining(void);
+u32 get_lapic_tick_count(void);
+void set_ioapic_base(u32 addr);
+void ioapic_route_isa(u32 irq, u32 pin, u32 redir);
+void ioapic_enable_irq(u32 irq);
+void ioapic_disable_irq(u32 irq);
+u32 ioapic_read_redir(u32 irq);
+u8 apic_irqs_enabled(void);
+void init_apic_irqs(void);
+
+#endif
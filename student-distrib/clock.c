@@ -0,0 +1,156 @@
+#include "clock.h"
+#include "lib.h"
+#include "pit.h"
+
+/* TSC frequency, measured at boot */
+static u32 tsc_khz;
+
+/* ns = cycles * cyc2ns_mult >> CLOCK_SHIFT */
+static u32 cyc2ns_mult;
+
+/* TSC at init_clock, so the clock starts at zero */
+static u64 tsc_base;
+
+/* div64_32
+ * Description: Divides a 64-bit number by a 32-bit one
+ * Inputs: n -- dividend
+ *         d -- divisor
+ *         rem -- where to store the remainder, or NULL
+ * Outputs: none
+ * Return Value: the quotient, which must fit in 32 bits
+ * Function: A single divl; we don't link libgcc's 64-bit division helpers
+ */
+u32 div64_32(u64 const n, u32 const d, u32* const rem) {
+  u32 q, r;
+
+  asm("divl %4" : "=a"(q), "=d"(r) : "a"((u32)n), "d"((u32)(n >> 32)), "rm"(d));
+
+  if (rem)
+    *rem = r;
+
+  return q;
+}
+
+/* rdtsc
+ * Description: Reads the time stamp counter
+ * Inputs: none
+ * Outputs: none
+ * Return Value: cycles since the CPU was reset
+ * Function: Uses the rdtsc instruction
+ */
+u64 rdtsc(void) {
+  u32 lo, hi;
+
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((u64)hi << 32) | lo;
+}
+
+/* init_clock
+ * Description: Calibrates the TSC against PIT channel 2
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Runs channel 2 for CLOCK_CALIBRATE_MS in one-shot mode with the speaker off and counts
+ *           how many cycles go by before its output goes high. Channel 0 is left alone.
+ * Reference: https://wiki.osdev.org/Detecting_CPU_Speed
+ */
+void init_clock(void) {
+  u32 const count = PIT_FREQ / MS_IN_SEC * CLOCK_CALIBRATE_MS;
+  u32 flags;
+  u64 start;
+
+  cli_and_save(flags);
+
+  /* Gate channel 2 off while it is programmed, and keep the speaker quiet */
+  outb(inb(PIT_GATE_PORT) & ~(PIT_GATE_CHANNEL_2 | PIT_SPEAKER_ENABLE), PIT_GATE_PORT);
+
+  outb(PIT_SET_CHANNEL_2 | PIT_SET_ACCESS_MODE_3 | PIT_SET_MODE_TERMINAL_COUNT |
+           PIT_SET_BCD_MODE_0,
+       PIT_MODE_REGISTER);
+  outb(count & LOWER_BYTE_MASK, PIT_CHANNEL_2);
+  outb(count >> UPPER_BYTE_SHIFT, PIT_CHANNEL_2);
+
+  /* Opening the gate starts the count */
+  outb(inb(PIT_GATE_PORT) | PIT_GATE_CHANNEL_2, PIT_GATE_PORT);
+  start = rdtsc();
+
+  while (!(inb(PIT_GATE_PORT) & PIT_OUT_CHANNEL_2))
+    ;
+
+  tsc_khz = (u32)(rdtsc() - start) / CLOCK_CALIBRATE_MS;
+
+  outb(inb(PIT_GATE_PORT) & ~PIT_GATE_CHANNEL_2, PIT_GATE_PORT);
+
+  /* Fits in 32 bits for anything faster than ~1MHz */
+  cyc2ns_mult = div64_32((u64)NS_IN_MS << CLOCK_SHIFT, tsc_khz, NULL);
+  tsc_base = rdtsc();
+
+  restore_flags(flags);
+}
+
+/* get_tsc_khz
+ * Description: Gets the calibrated TSC frequency
+ * Inputs: none
+ * Outputs: none
+ * Return Value: kHz
+ * Function: Returns what init_clock measured
+ */
+u32 get_tsc_khz(void) { return tsc_khz; }
+
+/* cycles_to_ns
+ * Description: Converts TSC cycles to nanoseconds
+ * Inputs: cycles -- number of cycles
+ * Outputs: none
+ * Return Value: nanoseconds
+ * Function: Multiplies by the fixed-point multiplier one 32-bit half at a time, so the intermediate
+ *           products can't overflow
+ */
+u64 cycles_to_ns(u64 const cycles) {
+  return (((u64)(u32)cycles * cyc2ns_mult) >> CLOCK_SHIFT) +
+         (((u64)(u32)(cycles >> 32) * cyc2ns_mult) << (32 - CLOCK_SHIFT));
+}
+
+/* cycles_to_us
+ * Description: Converts TSC cycles to microseconds, modulo 2^32
+ * Inputs: cycles -- number of cycles
+ * Outputs: none
+ * Return Value: low 32 bits of the microseconds, which wrap about every 71 minutes
+ * Function: Meant for differences. Divides the high word first so the divl quotient always fits.
+ */
+u32 cycles_to_us(u64 const cycles) {
+  u64 const ns = cycles_to_ns(cycles);
+
+  return div64_32(((u64)((u32)(ns >> 32) % NS_IN_US) << 32) | (u32)ns, NS_IN_US, NULL);
+}
+
+/* clock_ns
+ * Description: Gets a monotonic timestamp
+ * Inputs: none
+ * Outputs: none
+ * Return Value: nanoseconds since init_clock
+ * Function: Cheap enough to call anywhere, it's an rdtsc and two multiplies
+ */
+u64 clock_ns(void) { return cycles_to_ns(rdtsc() - tsc_base); }
+
+/* clock_timespec
+ * Description: Gets a monotonic timestamp split into seconds and nanoseconds
+ * Inputs: ts -- where to store the time
+ * Outputs: none
+ * Return Value: none
+ * Function: Splits clock_ns with a single division
+ */
+void clock_timespec(Timespec* const ts) { ts->sec = div64_32(clock_ns(), NS_IN_SEC, &ts->nsec); }
+
+/* clock_delay_us
+ * Description: Busy-waits
+ * Inputs: us -- microseconds to wait
+ * Outputs: none
+ * Return Value: none
+ * Function: Spins on clock_ns, so it works with interrupts off
+ */
+void clock_delay_us(u32 const us) {
+  u64 const end = clock_ns() + (u64)us * NS_IN_US;
+
+  while (clock_ns() < end)
+    asm volatile("pause");
+}
@@ -0,0 +1,30 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "types.h"
+
+enum {
+  CLOCK_CALIBRATE_MS = 50, /* Longest a 16-bit PIT count can measure is ~54ms */
+  CLOCK_SHIFT = 22,        /* Fixed-point fraction bits of the cycles -> ns multiplier */
+  NS_IN_SEC = 1000000000,
+  NS_IN_MS = 1000000,
+  NS_IN_US = 1000,
+  US_IN_SEC = 1000000
+};
+
+typedef struct Timespec {
+  u32 sec;
+  u32 nsec;
+} Timespec;
+
+void init_clock(void);
+u64 rdtsc(void);
+u32 div64_32(u64 n, u32 d, u32* rem);
+u32 get_tsc_khz(void);
+u64 cycles_to_ns(u64 cycles);
+u32 cycles_to_us(u64 cycles);
+u64 clock_ns(void);
+void clock_timespec(Timespec* ts);
+void clock_delay_us(u32 us);
+
+#endif
@@ -0,0 +1,168 @@
+#include "fpu.h"
+#include "lib.h"
+#include "syscall.h"
+
+/* Process whose registers are in the FPU right now, or NULL */
+static Pcb* fpu_owner;
+
+/* CPU features probed at boot */
+static u8 has_fxsr;
+static u8 has_sse;
+
+static void clts(void);
+static void stts(void);
+static void fpu_save(Pcb* pcb);
+static void fpu_restore(Pcb* pcb);
+
+/* clts
+ * Description: Clears CR0.TS
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: FPU instructions stop trapping with #NM
+ */
+static void clts(void) { asm volatile("clts"); }
+
+/* stts
+ * Description: Sets CR0.TS
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: The next FPU/SSE instruction traps with #NM
+ */
+static void stts(void) {
+  u32 cr0;
+
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  asm volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_TS));
+}
+
+/* fpu_save
+ * Description: Saves the FPU registers into a process' save area
+ * Inputs: pcb -- process that owns the registers
+ * Outputs: none
+ * Return Value: none
+ * Function: FXSAVE if the CPU has it, FNSAVE otherwise. TS must be clear.
+ */
+static void fpu_save(Pcb* const pcb) {
+  if (has_fxsr)
+    asm volatile("fxsave %0" : "=m"(pcb->fpu_state));
+  else
+    asm volatile("fnsave %0" : "=m"(pcb->fpu_state));
+}
+
+/* fpu_restore
+ * Description: Loads the FPU registers from a process' save area
+ * Inputs: pcb -- process to load
+ * Outputs: none
+ * Return Value: none
+ * Function: FXRSTOR if the CPU has it, FRSTOR otherwise. TS must be clear.
+ */
+static void fpu_restore(Pcb* const pcb) {
+  if (has_fxsr)
+    asm volatile("fxrstor %0" : : "m"(pcb->fpu_state));
+  else
+    asm volatile("frstor %0" : : "m"(pcb->fpu_state));
+}
+
+/* init_fpu
+ * Description: Sets up the FPU for lazy switching
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Turns off emulation, reports x87 errors as #MF and, when the CPU has them, enables
+ *           FXSAVE/FXRSTOR and SSE. TS starts out set so the first process to touch the FPU traps
+ *           into exc_nm and gets a clean state.
+ */
+void init_fpu(void) {
+  u32 eax, ebx, ecx, edx, cr0, cr4;
+
+  asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(CPUID_FEAT));
+  has_fxsr = !!(edx & CPUID_EDX_FXSR);
+  has_sse = has_fxsr && (edx & CPUID_EDX_SSE);
+
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  cr0 = (cr0 & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS;
+  asm volatile("mov %0, %%cr0" : : "r"(cr0));
+
+  if (has_fxsr) {
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | (has_sse ? CR4_OSXMMEXCPT : 0);
+    asm volatile("mov %0, %%cr4" : : "r"(cr4));
+  }
+
+  fpu_owner = NULL;
+}
+
+/* fpu_switch_to
+ * Description: Gets the FPU ready for a context switch
+ * Inputs: next -- process about to run
+ * Outputs: none
+ * Return Value: none
+ * Function: Nothing is saved here. If next already owns the FPU it can use it straight away;
+ *           otherwise TS is set and the save/restore is left to exc_nm, which only happens if
+ *           next actually touches the FPU.
+ */
+void fpu_switch_to(Pcb* const next) {
+  if (next == fpu_owner)
+    clts();
+  else
+    stts();
+}
+
+/* fpu_release
+ * Description: Forgets a halting process' FPU registers
+ * Inputs: pcb -- process that is going away
+ * Outputs: none
+ * Return Value: none
+ * Function: Keeps exc_nm from saving over the PCB of whoever gets the pid next
+ */
+void fpu_release(Pcb* const pcb) {
+  if (fpu_owner == pcb) {
+    fpu_owner = NULL;
+    stts();
+  }
+}
+
+/* get_fpu_owner
+ * Description: Gets the process whose registers are in the FPU
+ * Inputs: none
+ * Outputs: none
+ * Return Value: its PCB, or NULL
+ * Function: Getter for the lazy switching state
+ */
+Pcb* get_fpu_owner(void) { return fpu_owner; }
+
+/* exc_nm
+ * Description: Device Not Available handler; does the deferred half of an FPU context switch
+ * Inputs: ctx (UNUSED)
+ * Outputs: none
+ * Return Value: none
+ * Function: Clears TS, saves the previous owner's registers into its PCB and loads the current
+ *           process' ones. A process that has never used the FPU gets a freshly initialized one.
+ *           Runs with interrupts off, so ownership can't change underneath us.
+ */
+void exc_nm(HwContext* const UNUSED(ctx)) {
+  Pcb* const pcb = get_current_pcb();
+
+  clts();
+
+  if (fpu_owner == pcb)
+    return;
+
+  if (fpu_owner)
+    fpu_save(fpu_owner);
+
+  if (pcb->fpu_used) {
+    fpu_restore(pcb);
+  } else {
+    u32 const mxcsr = MXCSR_DEFAULT;
+
+    asm volatile("fninit");
+    if (has_sse)
+      asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+    pcb->fpu_used = 1;
+  }
+
+  fpu_owner = pcb;
+}
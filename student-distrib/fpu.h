@@ -0,0 +1,34 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "idt.h"
+#include "types.h"
+
+enum {
+  FPU_STATE_SIZE = 512,    /* FXSAVE image; the older FNSAVE one (108 bytes) fits too */
+  FPU_STATE_ALIGN = 16,    /* FXSAVE/FXRSTOR fault on anything less */
+  FPU_DEFAULT_CW = 0x037F, /* x87 control word after FNINIT */
+  MXCSR_DEFAULT = 0x1F80   /* Every SIMD exception masked, round to nearest */
+};
+
+enum {
+  CR0_MP = 1 << 1,
+  CR0_EM = 1 << 2,
+  CR0_TS = 1 << 3,
+  CR0_NE = 1 << 5,
+  CR4_OSFXSR = 1 << 9,
+  CR4_OSXMMEXCPT = 1 << 10,
+  CPUID_FEAT = 1,
+  CPUID_EDX_FXSR = 1 << 24,
+  CPUID_EDX_SSE = 1 << 25
+};
+
+struct Pcb;
+
+void init_fpu(void);
+void fpu_switch_to(struct Pcb* next);
+void fpu_release(struct Pcb* pcb);
+struct Pcb* get_fpu_owner(void);
+void exc_nm(HwContext* ctx);
+
+#endif
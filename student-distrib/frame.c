@@ -0,0 +1,219 @@
+#include "frame.h"
+#include "lib.h"
+#include "spinlock.h"
+
+/* One bit per 4KB physical frame, set while it is allocated or isn't usable RAM */
+static u32 frame_map[FRAME_MAP_WORDS];
+static u32 nr_total;
+static u32 nr_free;
+static Spinlock frame_lock;
+
+static void set_frames(u32 start, u32 end, u8 used);
+
+/* set_frames
+ * Description: Marks a physical address range used or free
+ * Inputs: start -- first byte of the range
+ *         end -- one past the last byte
+ *         used -- 1 to mark it used, 0 to mark it free
+ * Outputs: none
+ * Return Value: none
+ * Function: Only frames that lie entirely inside the range are freed, but any frame the range
+ *           touches is marked used. Anything past the direct map is ignored.
+ */
+static void set_frames(u32 const start, u32 const end, u8 const used) {
+  u32 first = used ? start >> FRAME_SHIFT : (start + FRAME_SIZE - 1) >> FRAME_SHIFT;
+  u32 last = used ? (end + FRAME_SIZE - 1) >> FRAME_SHIFT : end >> FRAME_SHIFT;
+
+  if (end <= start)
+    return;
+
+  if (last > MAX_FRAMES)
+    last = MAX_FRAMES;
+
+  for (; first < last; ++first)
+    if (used)
+      frame_map[first / FRAME_MAP_BITS] |= 1U << (first % FRAME_MAP_BITS);
+    else
+      frame_map[first / FRAME_MAP_BITS] &= ~(1U << (first % FRAME_MAP_BITS));
+}
+
+/* init_frames
+ * Description: Builds the free frame map from what the boot loader reports
+ * Inputs: mbi -- multiboot information
+ * Outputs: none
+ * Return Value: none
+ * Function: Frees every available region of the memory map (or, without one, the mem_upper
+ *           range above 1MB), then takes back the first 8MB and the boot modules
+ */
+void init_frames(multiboot_info_t const* const mbi) {
+  u32 i;
+
+  spin_init(&frame_lock, "frame");
+  memset(frame_map, 0xFF, sizeof(frame_map));
+
+  if (mbi->flags & MBI_FLAG_MMAP) {
+    memory_map_t const* mmap;
+
+    for (mmap = (memory_map_t const*)mbi->mmap_addr; (u32)mmap < mbi->mmap_addr + mbi->mmap_length;
+         mmap = (memory_map_t const*)((u32)mmap + mmap->size + sizeof(mmap->size))) {
+      /* We can't reach anything at or above 4GB */
+      if (mmap->type != MMAP_AVAILABLE || mmap->base_addr_high)
+        continue;
+
+      set_frames(mmap->base_addr_low,
+                 mmap->length_high || mmap->base_addr_low + mmap->length_low < mmap->base_addr_low
+                     ? 0xFFFFFFFF
+                     : mmap->base_addr_low + mmap->length_low,
+                 0);
+    }
+  } else if (mbi->flags & MBI_FLAG_MEM) {
+    set_frames(MEM_UPPER_START, MEM_UPPER_START + (mbi->mem_upper << KB_SHIFT), 0);
+  }
+
+  set_frames(0, FRAME_RESERVED_END, 1);
+
+  if (mbi->flags & MBI_FLAG_MODS) {
+    module_t const* const mods = (module_t const*)mbi->mods_addr;
+
+    for (i = 0; i < mbi->mods_count; ++i)
+      set_frames(mods[i].mod_start, mods[i].mod_end, 1);
+  }
+
+  for (i = 0, nr_free = 0; i < MAX_FRAMES; ++i)
+    if (!(frame_map[i / FRAME_MAP_BITS] & (1U << (i % FRAME_MAP_BITS))))
+      ++nr_free;
+
+  nr_total = nr_free;
+}
+
+/* frame_alloc
+ * Description: Allocates a 4KB physical frame
+ * Inputs: none
+ * Outputs: none
+ * Return Value: its physical address (also its kernel address, through the direct map), 0 if
+ *               memory is full
+ * Function: Searches from the top of memory down, leaving the bottom for 4MB frames
+ */
+u32 frame_alloc(void) {
+  u32 w, bit, flags;
+
+  spin_lock_irqsave(&frame_lock, flags);
+
+  for (w = FRAME_MAP_WORDS; w-- > 0;) {
+    if (frame_map[w] == 0xFFFFFFFF)
+      continue;
+
+    asm("bsrl %1, %0" : "=r"(bit) : "rm"(~frame_map[w]));
+    frame_map[w] |= 1U << bit;
+    --nr_free;
+
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return (w * FRAME_MAP_BITS + bit) << FRAME_SHIFT;
+  }
+
+  spin_unlock_irqrestore(&frame_lock, flags);
+  return 0;
+}
+
+/* frame_free
+ * Description: Frees a frame from frame_alloc
+ * Inputs: addr -- its physical address
+ * Outputs: none
+ * Return Value: none
+ * Function: Addresses that aren't allocated frames are ignored
+ */
+void frame_free(u32 const addr) {
+  u32 const i = addr >> FRAME_SHIFT;
+  u32 flags;
+
+  if (addr % FRAME_SIZE || i >= MAX_FRAMES || addr < FRAME_RESERVED_END)
+    return;
+
+  spin_lock_irqsave(&frame_lock, flags);
+
+  if (frame_map[i / FRAME_MAP_BITS] & (1U << (i % FRAME_MAP_BITS))) {
+    frame_map[i / FRAME_MAP_BITS] &= ~(1U << (i % FRAME_MAP_BITS));
+    ++nr_free;
+  }
+
+  spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+/* frame_alloc_4m
+ * Description: Allocates a 4MB-aligned run of 1024 frames, for a 4MB page
+ * Inputs: none
+ * Outputs: none
+ * Return Value: its physical address, 0 if no aligned run is free
+ * Function: Searches from the bottom of memory up; a run is free when its 32 map words are zero
+ */
+u32 frame_alloc_4m(void) {
+  u32 c, w, flags;
+
+  spin_lock_irqsave(&frame_lock, flags);
+
+  for (c = 0; c < FRAME_MAP_WORDS; c += FRAME_MAP_WORDS_4M) {
+    for (w = c; w < c + FRAME_MAP_WORDS_4M && !frame_map[w]; ++w)
+      ;
+
+    if (w < c + FRAME_MAP_WORDS_4M)
+      continue;
+
+    memset(&frame_map[c], 0xFF, FRAME_MAP_WORDS_4M * sizeof(*frame_map));
+    nr_free -= FRAMES_PER_4M;
+
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return (c * FRAME_MAP_BITS) << FRAME_SHIFT;
+  }
+
+  spin_unlock_irqrestore(&frame_lock, flags);
+  return 0;
+}
+
+/* frame_free_4m
+ * Description: Frees a run from frame_alloc_4m
+ * Inputs: addr -- its physical address
+ * Outputs: none
+ * Return Value: none
+ * Function: Addresses that aren't 4MB-aligned allocatable memory are ignored, and so are runs
+ *           with any frame already free, so a double free can't count the run twice
+ */
+void frame_free_4m(u32 const addr) {
+  u32 const c = (addr >> FRAME_SHIFT) / FRAME_MAP_BITS;
+  u32 w, flags;
+
+  if (addr % PG_4M_START || c >= FRAME_MAP_WORDS || addr < FRAME_RESERVED_END)
+    return;
+
+  spin_lock_irqsave(&frame_lock, flags);
+
+  for (w = c; w < c + FRAME_MAP_WORDS_4M && frame_map[w] == 0xFFFFFFFF; ++w)
+    ;
+
+  if (w < c + FRAME_MAP_WORDS_4M) {
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return;
+  }
+
+  memset(&frame_map[c], 0, FRAME_MAP_WORDS_4M * sizeof(*frame_map));
+  nr_free += FRAMES_PER_4M;
+
+  spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+/* frames_free
+ * Description: Counts free frames
+ * Inputs: none
+ * Outputs: none
+ * Return Value: number of free 4KB frames
+ * Function: Getter
+ */
+u32 frames_free(void) { return nr_free; }
+
+/* frames_total
+ * Description: Counts the frames the allocator manages
+ * Inputs: none
+ * Outputs: none
+ * Return Value: number of 4KB frames that were free at boot
+ * Function: Getter
+ */
+u32 frames_total(void) { return nr_total; }
@@ -0,0 +1,34 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "multiboot.h"
+#include "paging.h"
+#include "types.h"
+
+enum {
+  FRAME_SIZE = 0x1000,
+  FRAME_SHIFT = 12,
+  FRAMES_PER_4M = PGTBL_LEN,
+  FRAME_MAP_BITS = 32,
+  /* Only memory the kernel's direct map covers is handed out */
+  MAX_FRAMES = (DIRECT_MAP_END_PG << PG_4M_ADDR_OFFSET) >> FRAME_SHIFT,
+  FRAME_MAP_WORDS = MAX_FRAMES / FRAME_MAP_BITS,
+  FRAME_MAP_WORDS_4M = FRAMES_PER_4M / FRAME_MAP_BITS,
+  FRAME_RESERVED_END = 0x800000, /* Low memory, the kernel image and the PCBs/kernel stacks */
+  MMAP_AVAILABLE = 1,            /* Multiboot memory map type for usable RAM */
+  MBI_FLAG_MEM = 1 << 0,
+  MBI_FLAG_MODS = 1 << 3,
+  MBI_FLAG_MMAP = 1 << 6,
+  MEM_UPPER_START = 0x100000,    /* mem_upper counts from 1MB */
+  KB_SHIFT = 10
+};
+
+void init_frames(multiboot_info_t const* mbi);
+u32 frame_alloc(void);
+void frame_free(u32 addr);
+u32 frame_alloc_4m(void);
+void frame_free_4m(u32 addr);
+u32 frames_free(void);
+u32 frames_total(void);
+
+#endif
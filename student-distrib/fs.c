@@ -1,6 +1,7 @@
 #include "fs.h"
 #include "debug.h"
 #include "paging.h"
+#include "spinlock.h"
 #include "syscall.h"
 #include "x86_desc.h"
 
@@ -9,6 +10,9 @@ static Bootblk* bootblk = NULL;
 // How many things we've read
 static u32 dir_read_count = 0;
 
+// Guards dir_read_count, which every open directory shares
+static Spinlock fs_lock;
+
 /* open_fs
  * Description: Opens filesystem
  * Inputs: start -- The beginning
@@ -18,13 +22,15 @@ static u32 dir_read_count = 0;
  * Function: Opens the filesystem and sets the page directory to present
  */
 i32 open_fs(u32 const start, u32 const UNUSED(end)) {
+  spin_init(&fs_lock, "fs");
+
   bootblk = (Bootblk*)start;
   // Enable the filesystem 4mb page to be marked as present
-  pgdir[0][start >> PG_4M_ADDR_OFFSET] |= PG_PRESENT;
+  pgdir[start >> PG_4M_ADDR_OFFSET] |= PG_PRESENT;
 
   if (bootblk->fs_stats.direntry_cnt >= FS_MAX_DIR_ENTRIES) {
     // Reset state on page location
-    pgdir[0][start >> PG_4M_ADDR_OFFSET] &= ~(1U);
+    pgdir[start >> PG_4M_ADDR_OFFSET] &= ~(1U);
     return -1;
   }
 
@@ -89,6 +95,20 @@ i32 file_read_name(i8 const* const fname, void* const buf, u32 const offset, u32
   return read_data(dentry.inode_idx, offset, buf, size);
 }
 
+/* file_size
+ * Description: Gets a file's size
+ * Inputs: inode -- the file's inode
+ * Outputs: none
+ * Return Value: size in bytes, -1 if there is no such inode
+ * Function: none
+ */
+i32 file_size(u32 const inode) {
+  if (inode >= bootblk->fs_stats.inode_cnt)
+    return -1;
+
+  return (i32)((INode*)&bootblk[1])[inode].size;
+}
+
 /* file_write
  * Description: Writes file
  * Inputs: fd, buf, nbytes (UNUSED)
@@ -98,6 +118,15 @@ i32 file_read_name(i8 const* const fname, void* const buf, u32 const offset, u32
  */
 i32 file_write(i32 UNUSED(fd), void const* UNUSED(buf), i32 UNUSED(nbytes)) { return -1; }
 
+/* file_poll
+ * Description: Reports file readiness
+ * Inputs: fd, pt (UNUSED)
+ * Outputs: none
+ * Return Value: POLL_IN
+ * Function: File data is always in memory, so reads never block (and writes always fail)
+ */
+i32 file_poll(i32 UNUSED(fd), PollTable* UNUSED(pt)) { return POLL_IN; }
+
 /* dir_open
  * Description: Opens directory (and resets the read count for this directory)
  * Inputs: filename (UNUSED)
@@ -106,7 +135,12 @@ i32 file_write(i32 UNUSED(fd), void const* UNUSED(buf), i32 UNUSED(nbytes)) { re
  * Function: none currently
  */
 i32 dir_open(const u8* UNUSED(filename)) {
+  u32 flags;
+
+  spin_lock_irqsave(&fs_lock, flags);
   dir_read_count = 0;
+  spin_unlock_irqrestore(&fs_lock, flags);
+
   return 0;
 }
 
@@ -131,8 +165,16 @@ i32 dir_close(i32 UNUSED(fd)) { return 0; }
  */
 i32 dir_read(i32 UNUSED(fd), void* buf, i32 nbytes) {
   DirEntry d;
-  i32 const i = read_dentry_by_index(dir_read_count++, &d);
-  i32 const bytes = MIN(MIN(nbytes, 32), (i32)strlen(d.filename));
+  u32 idx, flags;
+  i32 i, bytes;
+
+  /* Claim an index atomically so two readers never get the same entry */
+  spin_lock_irqsave(&fs_lock, flags);
+  idx = dir_read_count++;
+  spin_unlock_irqrestore(&fs_lock, flags);
+
+  i = read_dentry_by_index(idx, &d);
+  bytes = MIN(MIN(nbytes, 32), (i32)strlen(d.filename));
 
   if (bytes < 0)
     return -1;
@@ -151,6 +193,15 @@ i32 dir_read(i32 UNUSED(fd), void* buf, i32 nbytes) {
  */
 i32 dir_write(i32 UNUSED(fd), void const* UNUSED(buf), i32 UNUSED(nbytes)) { return -1; }
 
+/* dir_poll
+ * Description: Reports directory readiness
+ * Inputs: fd, pt (UNUSED)
+ * Outputs: none
+ * Return Value: POLL_IN
+ * Function: Directory reads never block
+ */
+i32 dir_poll(i32 UNUSED(fd), PollTable* UNUSED(pt)) { return POLL_IN; }
+
 /* read_dentry_by_name
  * Description: Reads directory entry by name
  * Inputs: ufname -- name of the entry
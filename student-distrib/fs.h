@@ -3,6 +3,7 @@
 
 #include "lib.h"
 #include "util.h"
+#include "wait.h"
 
 enum { FS_MAX_DIR_ENTRIES = 63, FS_FNAME_LEN = 32, FS_INODE_DATA_LEN = 1023, FS_BLK_SIZE = 4096 };
 
@@ -42,16 +43,19 @@ i32 file_open(u8 const* filename);
 i32 file_close(i32 fd);
 i32 file_read(i32 fd, void* buf, i32 nbytes);
 i32 file_write(i32 fd, void const* buf, i32 nbytes);
+i32 file_poll(i32 fd, PollTable* pt);
 
 i32 dir_open(u8 const* filename);
 i32 dir_close(i32 fd);
 i32 dir_read(i32 fd, void* buf, i32 nbytes);
 i32 dir_write(i32 fd, void const* buf, i32 nbytes);
+i32 dir_poll(i32 fd, PollTable* pt);
 
 i32 read_dentry_by_name(u8 const* fname, DirEntry* dentry);
 i32 read_dentry_by_index(u32 index, DirEntry* dentry);
 i32 read_data(u32 inode, u32 offset, u8* buf, u32 length);
 
 i32 file_read_name(i8 const* fname, void* buf, u32 offset, u32 size);
+i32 file_size(u32 inode);
 
 #endif
@@ -0,0 +1,58 @@
+#include "heap.h"
+#include "frame.h"
+#include "lib.h"
+#include "syscall.h"
+
+static void shrink_heap(u8 pid, u32 from, u32 to);
+
+/* shrink_heap
+ * Description: Unmaps and frees the heap pages in a range
+ * Inputs: pid -- process whose heap it is
+ *         from -- first page-aligned address to free
+ *         to -- page-aligned end of the range
+ * Outputs: none
+ * Return Value: none
+ * Function: Pages that were never mapped are skipped
+ */
+static void shrink_heap(u8 const pid, u32 from, u32 const to) {
+  for (; from < to; from += FRAME_SIZE)
+    frame_free(unmap_user_page(pid, from));
+}
+
+/* sbrk
+ * Description: Grows or shrinks the current process' heap
+ * Inputs: increment -- bytes to move the break by; negative gives memory back
+ * Outputs: none
+ * Return Value: the old break on success, -1 if the heap would leave its window or memory is full
+ * Function: The heap runs from HEAP_START to the break. Every page the break moves over is
+ *           mapped to a zero-filled frame or freed. If a frame runs out midway, the pages mapped
+ *           so far are given back and the break stays where it was.
+ */
+i32 sbrk(i32 const increment) {
+  Pcb* const pcb = get_current_pcb();
+  u32 const old_brk = pcb->brk;
+  u32 const new_brk = old_brk + (u32)increment;
+  u32 const old_end = (old_brk + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1);
+  u32 const new_end = (new_brk + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1);
+  u32 page, frame;
+
+  if (increment < 0 ? new_brk > old_brk || new_brk < HEAP_START
+                    : new_brk < old_brk || new_brk > HEAP_END)
+    return -1;
+
+  for (page = old_end; page < new_end; page += FRAME_SIZE) {
+    if ((frame = frame_alloc()))
+      memset((void*)frame, 0, FRAME_SIZE);
+
+    if (!frame || map_user_page((u8)pcb->pid, page, frame, PG_RW)) {
+      frame_free(frame);
+      shrink_heap((u8)pcb->pid, old_end, page);
+      return -1;
+    }
+  }
+
+  shrink_heap((u8)pcb->pid, new_end, old_end);
+
+  pcb->brk = new_brk;
+  return (i32)old_brk;
+}
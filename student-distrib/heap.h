@@ -0,0 +1,14 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "paging.h"
+#include "types.h"
+
+enum {
+  HEAP_START = HEAP_PG * PG_4M_START, /* A new process' break */
+  HEAP_END = HEAP_END_PG * PG_4M_START
+};
+
+i32 sbrk(i32 increment);
+
+#endif
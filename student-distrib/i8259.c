@@ -2,8 +2,10 @@
  */
 
 #include "i8259.h"
+#include "apic.h"
 #include "debug.h"
 #include "lib.h"
+#include "pit.h"
 #include "util.h"
 
 /* Interrupt masks to determine which interrupts are enabled and disabled */
@@ -42,6 +44,11 @@ void init_i8259(void) {
 void enable_irq(u32 const irq_num) {
   ASSERT(irq_num < 16);
 
+  if (apic_irqs_enabled()) {
+    ioapic_enable_irq(irq_num);
+    return;
+  }
+
   /* Check if IRQ on master or slave */
   if (irq_num < 8) {
     master_mask &= (u8) ~(1U << irq_num);
@@ -56,6 +63,11 @@ void enable_irq(u32 const irq_num) {
 void disable_irq(u32 const irq_num) {
   ASSERT(irq_num < 16);
 
+  if (apic_irqs_enabled()) {
+    ioapic_disable_irq(irq_num);
+    return;
+  }
+
   /* Check if IRQ on master or slave */
   if (irq_num < 8) {
     master_mask |= (u8)(1U << irq_num);
@@ -70,6 +82,12 @@ void disable_irq(u32 const irq_num) {
 void send_eoi(u32 const irq_num) {
   ASSERT(irq_num < 16);
 
+  /* One MMIO store instead of one or two port writes */
+  if (apic_irqs_enabled()) {
+    lapic_eoi();
+    return;
+  }
+
   if (irq_num < 8)
     outb(irq_num | EOI, MASTER_8259_PORT);
   else {
@@ -77,3 +95,24 @@ void send_eoi(u32 const irq_num) {
     outb(EOI | SLAVE_IRQ, MASTER_8259_PORT);
   }
 }
+
+/* Hand the enabled IRQs over to the I/O APIC and mask everything here. The PIT's IRQ stays masked:
+ * the local APIC timer takes over the tick. The 8259 stays initialized as a fallback. */
+void i8259_to_ioapic(void) {
+  u32 irq;
+
+  for (irq = 0; irq < 16; ++irq) {
+    if (irq == SLAVE_IRQ || irq == PIT_IRQ)
+      continue;
+
+    if (((irq < 8) ? master_mask >> irq : slave_mask >> (irq - 8U)) & 1U)
+      continue;
+
+    ioapic_enable_irq(irq);
+  }
+
+  master_mask = 0xFF;
+  slave_mask = 0xFF;
+  outb(master_mask, MASTER_8259_DATA_PORT);
+  outb(slave_mask, SLAVE_8259_DATA_PORT);
+}
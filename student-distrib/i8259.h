@@ -40,5 +40,7 @@ void enable_irq(u32 irq_num);
 void disable_irq(u32 irq_num);
 /* Send end-of-interrupt signal for the specified IRQ */
 void send_eoi(u32 irq_num);
+/* Move interrupt delivery to the I/O APIC */
+void i8259_to_ioapic(void);
 
 #endif /* I8259_H */
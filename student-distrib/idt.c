@@ -1,59 +1,36 @@
+#include "idt.h"
 #include "lib.h"
+#include "signal.h"
+#include "smp.h"
 #include "syscall.h"
+#include "vm.h"
 
-#define ASM_EXC(name) void asm_##name(void);
-#define ASM_EXC_KEEPEAX(name) ASM_EXC(name)
-#define I_ASM_EXC(name, unused) ASM_EXC(name)
+#define ASM_EXC(name, vec) void asm_##name(void);
+#define ASM_EXC_KEEPEAX(name, vec) ASM_EXC(name, vec)
+#define ASM_EXC_ERRC(name, vec) ASM_EXC(name, vec)
+#define I_ASM_EXC(name, vec, errc, clobeax) ASM_EXC(name, vec)
 
 /* Some macro magic to choose whether we clear or not */
-#define CLR_true clear()
-#define CLR_false
-
-#define ERRC_true u32 errc
-#define ERRC_false
-
-#define INTSTACK_NAME_true IntStackE
-#define INTSTACK_NAME_false IntStack
-
-#define ERRC_PRINTF_true(str)                                                                      \
-  printf("EXC: " str ": errc: 0x%x, eip: 0x%x, eflags: 0x%x\n", stack.errc, stack.eip, stack.eflags)
-#define ERRC_PRINTF_false(str)                                                                     \
-  printf("EXC: " str ": eip: 0x%x, eflags: 0x%x\n", stack.eip, stack.eflags)
-
-#define INTSTACK(has_errc)                                                                         \
-  typedef struct INTSTACK_NAME_##has_errc {                                                        \
-    u32 flags;                                                                                     \
-    u32 edx;                                                                                       \
-    u32 ecx;                                                                                       \
-    u32 eax;                                                                                       \
-    ERRC_##has_errc;                                                                               \
-    u32 eip;                                                                                       \
-    u32 cs;                                                                                        \
-    u32 eflags;                                                                                    \
-    u32 esp;                                                                                       \
-    u32 ss;                                                                                        \
-  } PACKED INTSTACK_NAME_##has_errc
-
-INTSTACK(true);
-INTSTACK(false);
+#define CLR_true 1
+#define CLR_false 0
+
+#define ERRC_true 1
+#define ERRC_false 0
+
+static void handle_exception(HwContext* ctx, i8* str, u32 clear_screen, u32 has_errc);
 
 #define I_EXC_DFL(name, str, clear, errc)                                                          \
-  ASM_EXC(name)                                                                                    \
-  void name(INTSTACK_NAME_##errc stack);                                                           \
-  void name(INTSTACK_NAME_##errc stack) {                                                          \
-    CLR_##clear;                                                                                   \
-    ERRC_PRINTF_##errc(str);                                                                       \
-    set_program_exception(1); /* So we can return > 8 bit value */                                 \
-    halt(1);                                                                                       \
-  }
+  ASM_EXC(name, 0)                                                                                 \
+  void name(HwContext* ctx);                                                                       \
+  void name(HwContext* ctx) { handle_exception(ctx, str, CLR_##clear, ERRC_##errc); }
 
 /* Separate versions for whether we should clear the screen or not */
-#define EXC_DFL(name, str) I_EXC_DFL(name, str, true, false)
-#define EXC_DFL_NOCLR(name, str) I_EXC_DFL(name, str, false, false)
+#define EXC_DFL(name, vec, str) I_EXC_DFL(name, str, true, false)
+#define EXC_DFL_NOCLR(name, vec, str) I_EXC_DFL(name, str, false, false)
 
 /* Certain versions for accepting an error code at the top of the stack -- mainly for GPF */
-#define EXC_DFL_ERRC(name, str) I_EXC_DFL(name, str, true, true)
-#define EXC_DFL_ERRC_NOCLR(name, str) I_EXC_DFL(name, str, false, true)
+#define EXC_DFL_ERRC(name, vec, str) I_EXC_DFL(name, str, true, true)
+#define EXC_DFL_ERRC_NOCLR(name, vec, str) I_EXC_DFL(name, str, false, true)
 
 #define IDT_C
 
@@ -61,12 +38,12 @@ INTSTACK(false);
 
 #undef ASM_EXC
 #undef ASM_EXC_KEEPEAX
+#undef ASM_EXC_ERRC
 #undef I_ASM_EXC
 #undef CLR_true
 #undef CLR_false
 #undef ERRC_true
 #undef ERRC_false
-#undef INTSTACK
 #undef I_EXC_DFL
 #undef EXC_DFL
 #undef EXC_DFL_NOCLR
@@ -74,8 +51,6 @@ INTSTACK(false);
 #undef EXC_DFL_ERRC_NOCLR
 #undef IDT_C
 
-#include "idt.h"
-#include "lib.h"
 #include "util.h"
 #include "x86_desc.h"
 
@@ -120,6 +95,57 @@ static idt_desc_t make_idt_desc(void const* const handler, u16 const seg_selecto
   return ret;
 }
 
+/* handle_exception
+ * Description: Common handler for processor exceptions
+ * Inputs: ctx -- registers saved on entry
+ *         str -- name of the exception
+ *         clear_screen -- whether to clear the screen before reporting it
+ *         has_errc -- whether the CPU pushed a meaningful error code
+ * Outputs: none
+ * Return Value: none
+ * Function: Faults raised by userspace are turned into signals (DIV_ZERO for #DE, SEGFAULT for
+ *           everything else) and get delivered on the way back out. Faults inside the kernel are
+ *           reported and kill the running program.
+ */
+static void handle_exception(HwContext* const ctx, i8* const str, u32 const clear_screen,
+                             u32 const has_errc) {
+  if (ctx->cs & DPL3) {
+    send_signal(get_current_pcb()->pid, (ctx->irq == IDT_DE) ? SIG_DIV_ZERO : SIG_SEGFAULT);
+    return;
+  }
+
+  if (clear_screen)
+    clear();
+
+  if (has_errc)
+    printf("EXC: %s: errc: 0x%x, eip: 0x%x, eflags: 0x%x\n", str, ctx->errc, ctx->eip, ctx->eflags);
+  else
+    printf("EXC: %s: eip: 0x%x, eflags: 0x%x\n", str, ctx->eip, ctx->eflags);
+
+  set_program_exception(1); /* So we can return > 8 bit value */
+  halt(1);
+}
+
+void exc_pf(HwContext* ctx);
+
+/* exc_pf
+ * Description: Page fault handler
+ * Inputs: ctx -- registers saved on entry, with the CPU's error code
+ * Outputs: none
+ * Return Value: none
+ * Function: Faults on program pages that are demand-paged or copy-on-write are fixed up and the
+ *           access is retried, whether userspace or the kernel made it. Anything else is handled
+ *           like any other exception.
+ */
+void exc_pf(HwContext* const ctx) {
+  u32 addr;
+
+  asm volatile("mov %%cr2, %0" : "=r"(addr));
+
+  if (handle_page_fault((u8)get_current_pcb()->pid, addr, ctx->errc))
+    handle_exception(ctx, "Page Fault", 0, 1);
+}
+
 /**
  * init_idt
  * Description: Initializes and loads the IDT array.
@@ -150,6 +176,12 @@ void init_idt(void) {
   /* Syscall; use privilege lvl 3 for this to allow userspace calls */
   idt[IDT_SYSCALL] = make_idt_desc(asm_irqh_syscall, KERNEL_CS, INT, DPL3);
 
+  /* Application processors' timers */
+  idt[IDT_AP_TIMER] = make_idt_desc(asm_irqh_ap_timer, KERNEL_CS, INT, DPL0);
+
+  /* Local APIC spurious interrupts */
+  idt[IDT_SPURIOUS] = make_idt_desc(asm_irqh_spurious, KERNEL_CS, INT, DPL0);
+
   /* Load the IDT */
   lidt(idt_desc_ptr);
 }
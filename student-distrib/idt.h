@@ -3,7 +3,17 @@
 
 #include "lib.h"
 
-enum { IDT_EXC_CNT = 32, IDT_PIT = 0x20, IDT_KEYBOARD = 0x21, IDT_RTC = 0x28, IDT_SYSCALL = 0x80 };
+enum {
+  IDT_DE = 0x00,
+  IDT_PF = 0x0E,
+  IDT_EXC_CNT = 32,
+  IDT_PIT = 0x20,
+  IDT_KEYBOARD = 0x21,
+  IDT_RTC = 0x28,
+  IDT_SYSCALL = 0x80,
+  IDT_AP_TIMER = 0xF0, /* Application processors' local APIC timers */
+  IDT_SPURIOUS = 0xFF /* Local APIC spurious interrupts */
+};
 typedef enum Dpl { DPL0 = 0, DPL3 = 3 } Dpl;
 typedef enum GateType { TASK = 5, INT = 6, TRAP = 7 } GateType;
 typedef union GateTypeU {
@@ -17,6 +27,29 @@ typedef union GateTypeU {
 
 } GateTypeU;
 
+/* Registers saved by the linkage in idt_asm.S, lowest address first. This is also the hardware
+ * context a signal handler finds on its stack. ESP and SS are only valid when we came from
+ * userspace. */
+typedef struct HwContext {
+  u32 ebx;
+  u32 ecx;
+  u32 edx;
+  u32 esi;
+  u32 edi;
+  u32 ebp;
+  u32 eax;
+  u32 ds;
+  u32 es;
+  u32 fs;
+  u32 irq;
+  u32 errc;
+  u32 eip;
+  u32 cs;
+  u32 eflags;
+  u32 esp;
+  u32 ss;
+} PACKED HwContext;
+
 /* Initialize the IDT */
 void init_idt(void);
 
@@ -3,20 +3,30 @@
  */
 
 #include "kernel.h"
+#include "apic.h"
+#include "clock.h"
 #include "debug.h"
+#include "fpu.h"
+#include "frame.h"
 #include "fs.h"
 #include "i8259.h"
 #include "idt.h"
 #include "keyboard.h"
+#include "kmalloc.h"
 #include "lib.h"
 #include "multiboot.h"
 #include "paging.h"
+#include "pipe.h"
 #include "pit.h"
 #include "rtc.h"
+#include "shm.h"
+#include "smp.h"
 #include "syscall.h"
 #include "terminal_driver.h"
 #include "tests.h"
+#include "timer.h"
 #include "util.h"
+#include "vm.h"
 #include "x86_desc.h"
 
 #define RUN_TESTS
@@ -146,9 +156,19 @@ void entry(u32 const magic, u32 const addr) {
   init_i8259();
   init_keyboard();
   init_rtc();
+  init_frames(mbi);
+  printf("%u of %u KB free for processes and buffers\n", frames_free() * (FRAME_SIZE >> KB_SHIFT),
+         frames_total() * (FRAME_SIZE >> KB_SHIFT));
   init_paging();
+  init_kmalloc();
+  init_vm();
+  init_pipes();
+  init_shm();
   init_idt();
+  init_timers();
   init_pit();
+  init_clock();
+  init_fpu();
 
   /* Grab the first module and use it to open the filesystem */
   module_t* const mod = (module_t*)mbi->mods_addr;
@@ -159,6 +179,10 @@ void entry(u32 const magic, u32 const addr) {
     HLTLOOP;
   }
 
+  /* The trampoline overwrites low memory, so wait until we're done with the boot loader's data */
+  init_smp();
+  init_apic_irqs();
+
   clear();
 
 #ifdef RUN_TESTS
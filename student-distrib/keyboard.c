@@ -1,6 +1,8 @@
 #include "keyboard.h"
 #include "i8259.h"
 #include "lib.h"
+#include "pit.h"
+#include "signal.h"
 #include "syscall.h"
 #include "terminal_driver.h"
 /* Declare variables for keyboard */
@@ -42,9 +44,11 @@ int contains_newline(i8 const* const buf, i32 const size) {
  * the current line buf
  */
 i32 get_line_buf(char* const buf, i32 const nbytes) {
+  i8 line[LINE_BUFFER_SIZE];
   i32 lenstr;
   i32 nl_idx;
   terminal* term;
+  u32 flags;
 
   if (nbytes <= 0 || !buf)
     return -1;
@@ -54,30 +58,43 @@ i32 get_line_buf(char* const buf, i32 const nbytes) {
   if (!term)
     return -1;
 
-  term->read_flag = 1;
-
-  /* Wait while the line_buf does not contain a \n */
-  while ((nl_idx = contains_newline(term->line_buf, LINE_BUFFER_SIZE)) == -1)
-    ;
+  /* term_lock guards the line buf and read flag against the keyboard IRQ. It is dropped across
+   * the sleep, but interrupts stay off between the check and the sleep so the keyboard can't wake
+   * us too early. */
+  spin_lock_irqsave(&term_lock, flags);
 
-  {
-    i32 const limit = MIN(nl_idx + 1, nbytes);
+  term->read_flag = 1;
 
-    /* Copy from the line buf to the buf */
-    memcpy(buf, term->line_buf, (u32)limit);
+  /* Sleep while the line_buf does not contain a \n, giving up if a signal needs delivering */
+  while ((nl_idx = contains_newline(term->line_buf, LINE_BUFFER_SIZE)) == -1) {
+    if (signal_pending(get_current_pcb()->pid)) {
+      term->read_flag = 0;
+      spin_unlock_irqrestore(&term_lock, flags);
+      return -1;
+    }
 
-    /* Set the size of the string */
-    lenstr = limit;
+    spin_unlock(&term_lock);
+    wait_on(&term->read_wait);
+    spin_lock(&term_lock);
   }
 
-  /* Make sure that the last character is a newline */
-  buf[MIN(nbytes, LINE_BUFFER_SIZE)] = '\n';
+  /* Copy the line out before clearing it. The user buf may fault, so it is filled unlocked. */
+  lenstr = MIN(nl_idx + 1, nbytes);
+  memcpy(line, term->line_buf, (u32)lenstr);
 
-  /* clear the line buf and return the size of the buf written to */
+  /* clear the line buf */
   clear_line_buf();
 
   term->read_flag = 0;
 
+  spin_unlock_irqrestore(&term_lock, flags);
+
+  /* Copy from the line buf to the buf */
+  memcpy(buf, line, (u32)lenstr);
+
+  /* Make sure that the last character is a newline */
+  buf[MIN(nbytes, LINE_BUFFER_SIZE)] = '\n';
+
   return lenstr;
 }
 
@@ -105,9 +122,13 @@ void init_keyboard(void) {
  *               the typed key to the virtual machine window.
  */
 void irqh_keyboard(void) {
-  /* If a keypress is ready then handle it */
-  if (inb(KEYBOARD_STATUS_PORT) & KEYBOARD_OUTBUF_FULL)
+  /* If a keypress is ready then handle it. Interrupts are already off, so the lock is taken
+   * without saving them. */
+  if (inb(KEYBOARD_STATUS_PORT) & KEYBOARD_OUTBUF_FULL) {
+    spin_lock(&term_lock);
     handle_keypress(inb(KEYBOARD_DATA_PORT));
+    spin_unlock(&term_lock);
+  }
 
   /* Send EOI */
   send_eoi(KEYBOARD_IRQ);
@@ -156,13 +177,22 @@ void handle_keypress(SCSet1 const scancode) {
         send_eoi(KEYBOARD_IRQ);
         terminal_to_switch_to = 2;
       }
+      /* The PIT may be idling in one-shot mode; get it ticking so the switch happens promptly */
+      tick_nohz_stop();
     }
     /* If the command ctrl + l is pressed clear the screen */
     else if (key_state[SCS1_PRESSED_LEFTCTRL] && scancode == SCS1_PRESSED_L) {
       /* Clear screen and reset terminal */
       clear();
 
-    } else if (!term->read_flag) {
+    }
+    /* Ctrl + c interrupts whatever the displayed terminal is running */
+    else if (key_state[SCS1_PRESSED_LEFTCTRL] && scancode == SCS1_PRESSED_C) {
+      if (terminals[current_terminal].running)
+        send_signal_foreground(current_terminal, SIG_INTERRUPT);
+
+    } else if (!term->read_flag && !term->read_wait.waiters) {
+      /* Nobody is reading or polling this terminal */
       return;
     } else if (key_state[SCS1_PRESSED_BACKSPACE] == 1) {
       /* If there is data in the line buf and backspace is pressed
@@ -192,6 +222,10 @@ void handle_keypress(SCSet1 const scancode) {
         term->line_buf[term->line_buf_index] = disp;
         term->line_buf_index++;
       }
+
+      /* A full line is ready for whoever is reading or polling this terminal */
+      if (disp == '\n')
+        wake_up(&term->read_wait);
     }
 
   }
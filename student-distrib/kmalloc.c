@@ -0,0 +1,268 @@
+#include "kmalloc.h"
+#include "frame.h"
+#include "lib.h"
+
+static KmemCache caches[MAX_CACHES];
+static u32 cache_cnt;
+static KmemCache* size_caches[KMALLOC_CLASSES]; /* kmalloc's, smallest first */
+static i8* size_names[KMALLOC_CLASSES] = {"kmalloc-16",  "kmalloc-32",  "kmalloc-64", "kmalloc-128",
+                                          "kmalloc-256", "kmalloc-512", "kmalloc-1k"};
+
+static u32 slab_hdr_size(void);
+static Slab* new_slab(KmemCache* cache);
+static void unlink_slab(KmemCache* cache, Slab* slab);
+
+/* slab_hdr_size
+ * Description: Space the slab header takes at the start of its frame
+ * Inputs: none
+ * Outputs: none
+ * Return Value: header size rounded up to SLAB_ALIGN
+ * Function: Rounded up so the objects after it stay aligned
+ */
+static u32 slab_hdr_size(void) { return (sizeof(Slab) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1); }
+
+/* new_slab
+ * Description: Gives a cache another slab
+ * Inputs: cache -- cache that has run out of free objects, locked
+ * Outputs: none
+ * Return Value: the new slab, already at the head of the cache's partial list; NULL if memory
+ *               is full
+ * Function: Takes a frame (through the direct map) and threads every object onto its free list
+ */
+static Slab* new_slab(KmemCache* const cache) {
+  u32 const frame = frame_alloc();
+  Slab* slab;
+  u8* obj;
+  u32 i;
+
+  if (!frame)
+    return NULL;
+
+  slab = (Slab*)frame;
+  slab->cache = cache;
+  slab->inuse = 0;
+  slab->total = (u16)cache->per_slab;
+
+  obj = (u8*)frame + slab_hdr_size();
+  slab->free = obj;
+
+  for (i = 0; i + 1 < cache->per_slab; ++i, obj += cache->obj_size)
+    *(void**)obj = obj + cache->obj_size;
+  *(void**)obj = NULL;
+
+  slab->prev = NULL;
+  slab->next = cache->partial;
+  if (cache->partial)
+    cache->partial->prev = slab;
+  cache->partial = slab;
+  ++cache->nr_slabs;
+
+  return slab;
+}
+
+/* unlink_slab
+ * Description: Takes a slab off its cache's partial list
+ * Inputs: cache -- its cache, locked
+ *         slab -- slab to take off
+ * Outputs: none
+ * Return Value: none
+ * Function: Doubly linked, so this is O(1) wherever the slab is in the list
+ */
+static void unlink_slab(KmemCache* const cache, Slab* const slab) {
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    cache->partial = slab->next;
+
+  if (slab->next)
+    slab->next->prev = slab->prev;
+
+  slab->next = NULL;
+  slab->prev = NULL;
+}
+
+/* init_kmalloc
+ * Description: Sets up kmalloc's size-class caches
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Must come after init_frames and init_paging, since slabs are reached through the
+ *           direct map. No memory is taken until the first allocation.
+ */
+void init_kmalloc(void) {
+  u32 i;
+
+  for (i = 0; i < KMALLOC_CLASSES; ++i)
+    size_caches[i] = kmem_cache_create(size_names[i], 1U << (KMALLOC_MIN_SHIFT + i));
+}
+
+/* kmem_cache_create
+ * Description: Makes a cache for objects of one size
+ * Inputs: name -- shown by kmalloc_stats_print
+ *         size -- object size in bytes, at most half a frame
+ * Outputs: none
+ * Return Value: the cache, NULL if size is too big or every cache is taken
+ * Function: Sizes are rounded up to SLAB_ALIGN, and to at least a pointer for the free list.
+ *           Caches are never destroyed.
+ */
+KmemCache* kmem_cache_create(i8* const name, u32 size) {
+  KmemCache* cache;
+  u32 flags;
+
+  size = (MAX(size, sizeof(void*)) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+  if (size > (FRAME_SIZE - slab_hdr_size()) / 2)
+    return NULL;
+
+  cli_and_save(flags);
+
+  if (cache_cnt >= MAX_CACHES) {
+    restore_flags(flags);
+    return NULL;
+  }
+
+  cache = &caches[cache_cnt++];
+  restore_flags(flags);
+
+  cache->name = name;
+  cache->obj_size = size;
+  cache->per_slab = (FRAME_SIZE - slab_hdr_size()) / size;
+  cache->partial = NULL;
+  cache->nr_slabs = 0;
+  cache->nr_inuse = 0;
+  spin_init(&cache->lock, name);
+
+  return cache;
+}
+
+/* kmem_cache_alloc
+ * Description: Allocates an object from a cache
+ * Inputs: cache -- cache to allocate from
+ * Outputs: none
+ * Return Value: the object (not zeroed), NULL if memory is full
+ * Function: O(1): pops the first free object of the first slab with one. A slab that fills up
+ *           leaves the partial list, so the head always has room.
+ */
+void* kmem_cache_alloc(KmemCache* const cache) {
+  Slab* slab;
+  void* obj;
+  u32 flags;
+
+  spin_lock_irqsave(&cache->lock, flags);
+
+  if (!(slab = cache->partial) && !(slab = new_slab(cache))) {
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return NULL;
+  }
+
+  obj = slab->free;
+  slab->free = *(void**)obj;
+  ++cache->nr_inuse;
+
+  if (++slab->inuse == slab->total)
+    unlink_slab(cache, slab);
+
+  spin_unlock_irqrestore(&cache->lock, flags);
+  return obj;
+}
+
+/* kmem_cache_free
+ * Description: Returns an object to its cache
+ * Inputs: cache -- cache it came from
+ *         obj -- object to free
+ * Outputs: none
+ * Return Value: none
+ * Function: O(1): the slab is found by masking the address down to its frame. A full slab goes
+ *           back on the partial list; an empty one is given back to the frame allocator unless
+ *           it is the cache's only slab with room, so alternating alloc/free doesn't thrash.
+ */
+void kmem_cache_free(KmemCache* const cache, void* const obj) {
+  Slab* const slab = (Slab*)((u32)obj & ~(FRAME_SIZE - 1));
+  u32 flags;
+
+  spin_lock_irqsave(&cache->lock, flags);
+
+  if (slab->inuse-- == slab->total) {
+    slab->prev = NULL;
+    slab->next = cache->partial;
+    if (cache->partial)
+      cache->partial->prev = slab;
+    cache->partial = slab;
+  }
+
+  *(void**)obj = slab->free;
+  slab->free = obj;
+  --cache->nr_inuse;
+
+  if (!slab->inuse && (slab->prev || slab->next)) {
+    unlink_slab(cache, slab);
+    --cache->nr_slabs;
+    spin_unlock_irqrestore(&cache->lock, flags);
+    frame_free((u32)slab);
+    return;
+  }
+
+  spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/* kmalloc
+ * Description: Allocates kernel memory
+ * Inputs: size -- bytes wanted, at most a frame
+ * Outputs: none
+ * Return Value: the memory (not zeroed), NULL if size is 0 or too big, or memory is full
+ * Function: Up to 1KB comes from the smallest size class that fits; anything bigger gets a whole
+ *           frame. Nothing is stored with the allocation: whole frames are page-aligned and slab
+ *           objects never are, which is all kfree needs.
+ */
+void* kmalloc(u32 const size) {
+  u32 i, frame;
+
+  if (!size || size > FRAME_SIZE)
+    return NULL;
+
+  if (size > 1U << KMALLOC_MAX_SHIFT) {
+    frame = frame_alloc();
+    return (void*)frame;
+  }
+
+  for (i = 0; size > 1U << (KMALLOC_MIN_SHIFT + i); ++i)
+    ;
+
+  return kmem_cache_alloc(size_caches[i]);
+}
+
+/* kfree
+ * Description: Frees memory from kmalloc
+ * Inputs: ptr -- memory to free, or NULL
+ * Outputs: none
+ * Return Value: none
+ * Function: A page-aligned pointer is a whole frame; anything else belongs to the cache named in
+ *           its slab's header
+ */
+void kfree(void* const ptr) {
+  if (!ptr)
+    return;
+
+  if (!((u32)ptr % FRAME_SIZE))
+    frame_free((u32)ptr);
+  else
+    kmem_cache_free(((Slab*)((u32)ptr & ~(FRAME_SIZE - 1)))->cache, ptr);
+}
+
+/* kmalloc_stats_print
+ * Description: Prints how full every cache's slabs are
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Utilization is objects in use over the room all of the cache's slabs have
+ */
+void kmalloc_stats_print(void) {
+  u32 i;
+
+  for (i = 0; i < cache_cnt; ++i) {
+    KmemCache const* const c = &caches[i];
+    u32 const total = c->nr_slabs * c->per_slab;
+
+    printf("%s: %u-byte objects, %u slabs, %u of %u in use (%u%%)\n", c->name, c->obj_size,
+           c->nr_slabs, c->nr_inuse, total, total ? c->nr_inuse * 100 / total : 0);
+  }
+}
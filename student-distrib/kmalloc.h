@@ -0,0 +1,47 @@
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+#include "spinlock.h"
+#include "types.h"
+
+enum {
+  KMALLOC_MIN_SHIFT = 4,  /* Smallest size class is 16 bytes */
+  KMALLOC_MAX_SHIFT = 10, /* Largest is 1KB; bigger requests get whole frames */
+  KMALLOC_CLASSES = KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1,
+  MAX_CACHES = 16,
+  SLAB_ALIGN = 8
+};
+
+struct KmemCache;
+
+/* Header at the start of each slab's frame; objects fill the rest, so a slab object is never
+ * page-aligned and kfree can tell it from a whole-frame allocation */
+typedef struct Slab {
+  struct Slab* next; /* Cache's list of slabs with free objects */
+  struct Slab* prev;
+  struct KmemCache* cache;
+  void* free; /* Free objects, each holding a pointer to the next */
+  u16 inuse;
+  u16 total;
+} Slab;
+
+/* Objects of one size, carved out of single-frame slabs */
+typedef struct KmemCache {
+  i8* name;
+  u32 obj_size;
+  u32 per_slab;
+  Slab* partial; /* Slabs with at least one free object */
+  u32 nr_slabs;
+  u32 nr_inuse;
+  Spinlock lock;
+} KmemCache;
+
+void init_kmalloc(void);
+KmemCache* kmem_cache_create(i8* name, u32 size);
+void* kmem_cache_alloc(KmemCache* cache);
+void kmem_cache_free(KmemCache* cache, void* obj);
+void* kmalloc(u32 size);
+void kfree(void* ptr);
+void kmalloc_stats_print(void);
+
+#endif
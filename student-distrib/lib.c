@@ -4,6 +4,7 @@
 #include "paging.h"
 #include "syscall.h"
 #include "terminal_driver.h"
+#include "vm.h"
 
 static u16 screen_x;
 static u16 screen_y;
@@ -14,12 +15,12 @@ static i8* video_mem = (i8*)VIDEO;
  * Return Value: none
  * Function: Clears video memory */
 void clear(void) {
-  u32 i;
+  u32 i, flags;
   terminal* term = get_running_terminal();
   /* If there is a terminal running and it is not the current map video->videos */
   u8 remap_vid_mem = 0;
   if (term && term->id != current_terminal) {
-    cli();
+    cli_and_save(flags);
     remap_vid_mem = 1;
     map_vid_mem(get_current_pcb()->pid, (u32)VIDEO, (u32)VIDEO);
   }
@@ -32,7 +33,7 @@ void clear(void) {
   if (remap_vid_mem) {
     map_vid_mem(get_current_pcb()->pid, (u32)VIDEO, (u32)term->vid_mem_buf);
     set_terminal_screen_xy(current_terminal, 0, 0);
-    sti();
+    restore_flags(flags);
   }
   /* Set screen pos to 0,0 */
   set_screen_xy(0, 0);
@@ -805,3 +806,46 @@ void test_interrupts(void) {
     video_mem[i << 1]++;
   }
 }
+
+/* i32 bad_userspace_addr(const void* addr, i32 len)
+ * Inputs: const void* addr = start of the buffer to check
+ *                  i32 len = length of the buffer in bytes
+ * Return Value: 1 if any byte of the buffer isn't mapped user-accessible, 0 otherwise
+ * Function: walks the current page directory over every page the buffer touches. Pages of the
+ *           program window and the stack that haven't been touched yet count as mapped, since
+ *           the page fault handler fills them in on first use */
+i32 bad_userspace_addr(const void* addr, i32 len) {
+  u32 const perm = PG_PRESENT | PG_USPACE;
+  u32 const start = (u32)addr;
+  u32 const end = start + (u32)len - 1;
+  u32 const* pgdir;
+  u32 page;
+
+  if (len <= 0)
+    return len < 0;
+
+  /* Wrapped around the top of the address space */
+  if (end < start)
+    return 1;
+
+  /* Page directories and tables live in identity-mapped kernel memory */
+  asm volatile("mov %%cr3, %0" : "=r"(pgdir));
+
+  for (page = start & ~(PTE_SIZE - 1); page <= end && page >= (start & ~(PTE_SIZE - 1));
+       page += PTE_SIZE) {
+    u32 const pde = pgdir[page >> PG_4M_ADDR_OFFSET];
+
+    if ((pde & perm) != perm)
+      return 1;
+
+    if (!(pde & PG_SIZE)) {
+      u32 const* const pgtbl = (u32 const*)(pde & ~(PTE_SIZE - 1));
+      u32 const pte = pgtbl[(page / PTE_SIZE) % PGTBL_LEN];
+
+      if ((pte & perm) != perm && (pte || !is_demand_paged(page)))
+        return 1;
+    }
+  }
+
+  return 0;
+}
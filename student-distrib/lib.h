@@ -14,6 +14,8 @@
 
 enum { ATTRIB = 2, NUM_ROWS = 25, NUM_COLS = 80, VIDEO = 0xB8000 };
 
+#define EFLAGS_IF 0x200 /* Interrupt enable flag, as saved by cli_and_save */
+
 i32 printf(i8* format, ...);
 void putc(i8 c);
 i32 puts(i8* s);
@@ -3,6 +3,12 @@
 
 #define TESTS_ENABLED 1
 
+/* Count acquisitions, contention and hold time per spinlock (lock_stats_print) */
+#define LOCK_STATS 0
+
+/* Map VGA text memory write-combining through the PAT; 0 leaves it uncached (see blitbench) */
+#define VIDMEM_WC 1
+
 /* BSOD */
 #define ENABLE_TEST_DIV_ZERO 0
 #define ENABLE_TEST_UD 0
@@ -26,6 +32,29 @@
 #define ENABLE_TEST_EXEC_LS 0
 #define ENABLE_TEST_EXEC_TESTPRINT 0
 
+#define ENABLE_TEST_TIMER 0
+#define ENABLE_TEST_NOHZ 0
+#define ENABLE_TEST_CLOCK 0
+#define ENABLE_TEST_ACCT 0
+#define ENABLE_TEST_FPU 0
+#define ENABLE_TEST_SIGNALS 0
+#define ENABLE_TEST_WAIT_QUEUE 0
+#define ENABLE_TEST_RUN_QUEUE 0
+#define ENABLE_TEST_NICE 0
+#define ENABLE_TEST_SMP 0
+#define ENABLE_TEST_APIC 0
+#define ENABLE_TEST_SPINLOCK 0
+#define ENABLE_TEST_FRAMES 0
+#define ENABLE_TEST_SLAB 0
+#define ENABLE_TEST_PIPE 0
+#define ENABLE_TEST_SHM 0
+#define ENABLE_TEST_TASK_PGDIR 0
+#define ENABLE_TEST_HEAP 0
+#define ENABLE_TEST_IMAGE 0
+#define ENABLE_TEST_ZERO_POOL 0
+#define ENABLE_TEST_USER_STACK 0
+#define ENABLE_TEST_PAT 0
+
 /* RTC demonstrations */
 #define RTC_RANDOM_TEXT_DEMO 0 /* CP1 */
 #define ENABLE_TEST_RTC_DEMO 0 /* CP2 */
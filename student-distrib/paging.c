@@ -1,8 +1,24 @@
 #include "paging.h"
+#include "fpu.h"
+#include "frame.h"
 #include "lib.h"
+#include "options.h"
 #include "syscall.h"
+#include "vm.h"
 #include "x86_desc.h"
 
+/* Each process' page directory, from the frame allocator; NULL if it has none */
+static u32* task_pgdir[NUM_PROC];
+
+/* Extra PTE bits for VGA memory: PG_PAT_WC once init_pat has set up write-combining, else 0 */
+static u32 vid_cache;
+
+static u32 get_cr3(void);
+static void set_cr3(u32 const* dir);
+static u32 const* get_pgdir(u8 proc);
+static void map_kernel_pdes(u32* dir);
+static void free_private(u32 const* dir, u32 start_pg, u32 end_pg);
+
 /*
  * 4MB to 8MB is kernel, 0MB to 4MB is 4KB pages 8MB to 4GB is 4MB
  * Differentiating 4MB and 4KB is bit 7 in PDE (0 = 4KB, 1 = 4MB)
@@ -23,93 +39,198 @@ void init_paging(void) {
   /* Initialize page tables */
   u32 i;
 
+  /* Before any mapping uses PAT entry 1 */
+  init_pat();
+
   /* Page table set to i * 4096. R = 1 */
   pgtbl[0] = PG_RW;
 
+  /* Not global: processes map the same addresses user-accessible in their own tables */
   for (i = 1; i < PGTBL_LEN; ++i)
-    pgtbl[i] = (i * PTE_SIZE) | PG_RW | PG_PRESENT;
+    pgtbl[i] = (i * PTE_SIZE) | PG_RW | PG_PRESENT | ((i == PG_VIDMEM_START) ? vid_cache : 0);
 
   /* Set video memory. R = 1, P = 1; We may want userspace access in the future */
   /* pgtbl[PG_VIDMEM_START] |= PG_USPACE; */
 
   /* Set first pgdir entry to pgtbl */
-  pgdir[0][0] = (u32)pgtbl | PG_RW | PG_PRESENT;
-
-  /* Kernel page setup */
-  pgdir[0][1] = PG_4M_START | PG_RW | PG_SIZE | PG_PRESENT;
+  pgdir[0] = (u32)pgtbl | PG_RW | PG_PRESENT;
 
   /* Set up remaining page directories. */
   for (i = 2; i < PGDIR_LEN; ++i)
-    pgdir[0][i] = (i * PG_4M_START) | PG_RW | PG_USPACE | PG_SIZE;
+    pgdir[i] = (i * PG_4M_START) | PG_RW | PG_USPACE | PG_SIZE;
+
+  /* Kernel page, direct map and APIC registers */
+  map_kernel_pdes(pgdir);
 
   /* Enable paging.
    * CR3     = pgdir
    * CR4.PSE = 1 (Enable 4MiB pages)
    * CR0.PG  = 1 (Enable paging)
+   * CR4.PGE = 1 (Keep global pages across CR3 loads; set once paging is on)
+   * CR0.WP  = 1 (Kernel writes to copy-on-write pages fault as well)
    */
   asm volatile("mov %0, %%cr3;"
 
                "mov %%cr4, %%eax;"
-               "or $0x10, %%eax;"
+               "or %1, %%eax;"
                "mov %%eax, %%cr4;"
 
                "mov %%cr0, %%eax;"
                "or $0x80000000, %%eax;"
+               "or %3, %%eax;"
                "mov %%eax, %%cr0;"
+
+               "mov %%cr4, %%eax;"
+               "or %2, %%eax;"
+               "mov %%eax, %%cr4;"
                :
-               : "g"(pgdir[0])
+               : "g"(pgdir), "i"(CR4_PSE), "i"(CR4_PGE), "i"(CR0_WP)
                : "eax");
 }
 
+/* init_pat
+ * Description: Makes PAT entry 1 write-combining, for VGA memory
+ * Inputs: None
+ * Outputs: None
+ * Return Value: none
+ * Function: Entry 1 is what PWT alone selects in a 4KB page, and nothing else maps that way, so
+ *           every other page keeps its memory type. Writes to VGA memory then reach the card in
+ *           bursts instead of one uncached access each. All CPUs must agree on the PAT, so the
+ *           application processors call this too. Does nothing without a PAT or with VIDMEM_WC
+ *           off, leaving video memory uncached.
+ */
+void init_pat(void) {
+#if VIDMEM_WC
+  u32 eax, ebx, ecx, edx, lo, hi;
+
+  asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(CPUID_FEAT));
+  if (!(edx & CPUID_EDX_PAT))
+    return;
+
+  asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(MSR_PAT));
+  lo = (lo & ~(0xFFU << PAT_ENTRY_BITS)) | (PAT_WC << PAT_ENTRY_BITS);
+
+  /* Nothing may be cached under the old type when it changes */
+  asm volatile("wbinvd;"
+               "wrmsr;"
+               "wbinvd;"
+               :
+               : "a"(lo), "d"(hi), "c"(MSR_PAT)
+               : "memory");
+
+  vid_cache = PG_PAT_WC;
+#endif
+}
+
+/* map_kernel_pdes
+ * Description: Fills in the page directory entries every address space shares
+ * Inputs: dir -- page directory to fill in
+ * Outputs: None
+ * Return Value: none
+ * Function: Maps the kernel's 4MB page, the direct map of the memory the frame allocator hands
+ *           out and the APIC registers. All are kernel-only and global.
+ */
+static void map_kernel_pdes(u32* const dir) {
+  u32 i;
+
+  /* Kernel page setup */
+  dir[1] = PG_4M_START | PG_RW | PG_SIZE | PG_GLOBAL | PG_PRESENT;
+
+  /* Lets the kernel reach any frame by its physical address */
+  for (i = DIRECT_MAP_START_PG; i < DIRECT_MAP_END_PG; ++i)
+    dir[i] = (i * PG_4M_START) | PG_RW | PG_SIZE | PG_GLOBAL | PG_PRESENT;
+
+  /* Kernel-only, uncached window onto the APIC registers */
+  dir[APIC_PG] =
+      ((u32)APIC_PG * PG_4M_START) | PG_RW | PG_PCD | PG_PWT | PG_SIZE | PG_GLOBAL | PG_PRESENT;
+}
+
 /* make_task_pgdir
- * Description: Sets up a page table for a process.
- * Inputs: proc -- process id to make page table for
+ * Description: Sets up a page directory for a process.
+ * Inputs: proc -- process id to make page directory for
  * Outputs: None
  * Return Value: -1 on failure, 0 on success
- * Function: Sets up a page table for a process and flushes the tlb
+ * Function: The directory and the table for the low 4MB come from the frame allocator; the
+ *           kernel's entries are the same in every directory. The program window starts out
+ *           empty for map_image. Loads the new directory once it is complete, flushing the TLB.
  */
 i32 make_task_pgdir(u8 const proc) {
-  u32 i;
+  u32 dir, low, i;
 
   /* If there are more than 8 processes, fail */
   /* It says >= because 0-7 are our 8 processes */
-  if (proc >= NUM_PROC)
+  if (proc >= NUM_PROC || task_pgdir[proc])
     return -1;
 
+  dir = frame_alloc();
+  low = dir ? frame_alloc() : 0;
+
+  /* frame_free ignores the one we didn't get */
+  if (!low) {
+    frame_free(dir);
+    return -1;
+  }
+
   /* Initialize page table for process */
-  pgtbl_proc[proc][0] = PG_USPACE | PG_RW;
+  ((u32*)low)[0] = PG_USPACE | PG_RW;
 
+  /* An identity map like the kernel's, but user-accessible, so neither copy can be global: a
+   * global translation from one would outlive the CR3 load into the other */
   for (i = 1; i < PGTBL_LEN; ++i)
-    pgtbl_proc[proc][i] = (i * PTE_SIZE) | PG_USPACE | PG_RW | PG_PRESENT;
+    ((u32*)low)[i] = (i * PTE_SIZE) | PG_USPACE | PG_RW | PG_PRESENT |
+                     ((i == PG_VIDMEM_START) ? vid_cache : 0);
+
+  /* Everything else, the program, shared memory and the heap included, starts out empty */
+  memset((void*)dir, 0, FRAME_SIZE);
 
   /* Initialize page directory 4KB pages */
-  pgdir[proc][0] = (u32)(pgtbl_proc[proc]) | PG_USPACE | PG_RW | PG_PRESENT;
+  ((u32*)dir)[0] = low | PG_USPACE | PG_RW | PG_PRESENT;
 
   /* Initialize page directory kernel */
-  pgdir[proc][1] = PG_4M | PG_RW | PG_SIZE | PG_PRESENT;
+  map_kernel_pdes((u32*)dir);
 
-  /* Initialize page directory 4MB pages */
-  pgdir[proc][ELF_LOAD_PG] = ((proc + 2) * MB4) | PG_SIZE | PG_USPACE | PG_RW | PG_PRESENT;
+  task_pgdir[proc] = (u32*)dir;
 
   /* Sets up page directory for process and flushes TLB */
-  asm volatile("mov %0, %%cr3;" ::"g"(pgdir[proc]));
+  set_cr3(task_pgdir[proc]);
 
   return 0;
 }
 
 /* remove_task_pgdir
- * Description: Removes a processes page table
- * Inputs: proc -- process id to remove page table
+ * Description: Removes a process' page directory
+ * Inputs: proc -- process id to remove page directory
  * Outputs: None
- * Return Value: 0 on success
- * Function: Removes a page table for a process and flushes the tlb
+ * Return Value: -1 if it has none, 0 on success
+ * Function: Gives back the program's private pages, the heap, every page table and the
+ *           directory itself, and lets go of the program image. If the directory is loaded,
+ *           switches to the kernel's first so the CPU never walks freed frames; callers load the
+ *           next address space themselves.
  */
 i32 remove_task_pgdir(u8 const proc) {
-  /* Mark page as not present */
-  pgdir[proc][ELF_LOAD_PG] &= ~PG_PRESENT;
+  u32* const dir = proc < NUM_PROC ? task_pgdir[proc] : NULL;
+  u32 i;
 
-  /* Sets up page directory for process and flushes TLB */
-  asm volatile("mov %0, %%cr3;" ::"g"(pgdir[proc]));
+  if (!dir)
+    return -1;
+
+  if (get_cr3() == (u32)dir)
+    set_cr3(pgdir);
+
+  /* Shared memory frames belong to their segments and image frames to the image cache */
+  free_private(dir, ELF_LOAD_PG, ELF_LOAD_PG + 1);
+  free_private(dir, HEAP_PG, HEAP_END_PG);
+  free_private(dir, STACK_PG, STACK_PG + 1);
+  release_image(proc);
+
+  /* Page tables; the vidmap page reuses the low 4MB's, which is only freed once */
+  for (i = 0; i < PGDIR_LEN; ++i)
+    if ((dir[i] & PG_PRESENT) && !(dir[i] & PG_SIZE) &&
+        (!i || (dir[i] & ~(PTE_SIZE - 1)) != (dir[0] & ~(PTE_SIZE - 1))))
+      frame_free(dir[i] & ~(PTE_SIZE - 1));
+
+  frame_free((u32)dir);
+  task_pgdir[proc] = NULL;
 
   return 0;
 }
@@ -121,31 +242,211 @@ i32 remove_task_pgdir(u8 const proc) {
  *            physical_address -- The physical address to map to
  * Outputs: None
  * Return Value: -1 on failure, 0 on success
- * Function: Remaps a virtual address into a physical address and flushes the tlb.
+ * Function: Remaps a virtual address into a physical address, invalidating that page if the
+ *           process' page directory is the one loaded. The scheduler remaps the next task before loading it.
  */
 i32 map_vid_mem(u8 const proc, u32 virtual_address, u32 physical_address) {
-  cli();
+  u32* const dir = proc < NUM_PROC ? task_pgdir[proc] : NULL;
+  u32 flags;
 
-  /* If process id is valid and physical address is not in kernel space */
-  if (proc >= NUM_PROC)
+  /* If the process has an address space (before the first one starts, there is nothing to do) */
+  if (!dir)
     return -1;
 
-  /* Map page table to page directory */
-  pgdir[proc][virtual_address / MB4] = (u32)(pgtbl_proc[proc]) | PG_USPACE | PG_RW | PG_PRESENT;
+  cli_and_save(flags);
+
+  /* Map page table to page directory; the vidmap page shares the low 4MB's table */
+  dir[virtual_address / MB4] = (dir[0] & ~(PTE_SIZE - 1)) | PG_USPACE | PG_RW | PG_PRESENT;
 
   /* Map page table entry to page table. Sets virtual address */
-  pgtbl_proc[proc][(virtual_address % MB4) / KB4] =
-      physical_address | PG_USPACE | PG_RW | PG_PRESENT;
+  ((u32*)(dir[0] & ~(PTE_SIZE - 1)))[(virtual_address % MB4) / KB4] =
+      physical_address | ((physical_address == VIDMEM_START) ? vid_cache : 0) | PG_USPACE | PG_RW |
+      PG_PRESENT;
 
-  /* Sets up page directory for process and flushes TLB */
-  asm volatile("mov %0, %%cr3;" ::"g"(pgdir[proc]));
+  /* Only the loaded page directory can have stale translations, and only for this page */
+  if (get_cr3() == (u32)dir)
+    invlpg(virtual_address);
+
+  restore_flags(flags);
+  return 0;
+}
+
+/* map_user_page
+ * Description: Maps a 4KB frame into a process' address space
+ * Inputs: proc -- process to map it into
+ *         vaddr -- page-aligned user address
+ *         frame -- physical address of the frame, from frame_alloc
+ *         flags -- PG_RW for a private page, PG_COW for a read-only one shared with the image cache
+ * Outputs: None
+ * Return Value: -1 if there was no frame for a new page table, 0 on success
+ * Function: Page tables come from the frame allocator too, the first time a page in their 4MB is
+ *           mapped. The kernel reaches them through the direct map. Whatever was mapped there
+ *           before is replaced.
+ */
+i32 map_user_page(u8 const proc, u32 const vaddr, u32 const frame, u32 const flags) {
+  u32* const dir = proc < NUM_PROC ? task_pgdir[proc] : NULL;
+  u32 irq_flags, table;
+  u32* pde;
+
+  if (!dir)
+    return -1;
+
+  cli_and_save(irq_flags);
+
+  pde = &dir[vaddr >> PG_4M_ADDR_OFFSET];
+  if (!(*pde & PG_PRESENT) || (*pde & PG_SIZE)) {
+    if (!(table = frame_alloc())) {
+      restore_flags(irq_flags);
+      return -1;
+    }
+
+    memset((void*)table, 0, FRAME_SIZE);
+    *pde = table | PG_USPACE | PG_RW | PG_PRESENT;
+  }
 
-  sti();
+  ((u32*)(*pde & ~(PTE_SIZE - 1)))[(vaddr >> FRAME_SHIFT) % PGTBL_LEN] =
+      frame | (flags & (PG_RW | PG_COW)) | PG_USPACE | PG_PRESENT;
+
+  if (get_cr3() == (u32)dir)
+    invlpg(vaddr);
+
+  restore_flags(irq_flags);
   return 0;
 }
 
+/* get_user_pte
+ * Description: Looks up how a 4KB user page is mapped
+ * Inputs: proc -- process to look in
+ *         vaddr -- user address in the page
+ * Outputs: None
+ * Return Value: the page table entry, 0 if the process or the page table doesn't exist
+ * Function: none
+ */
+u32 get_user_pte(u8 const proc, u32 const vaddr) {
+  u32 const* const dir = proc < NUM_PROC ? task_pgdir[proc] : NULL;
+  u32 pde;
+
+  if (!dir)
+    return 0;
+
+  pde = dir[vaddr >> PG_4M_ADDR_OFFSET];
+  if (!(pde & PG_PRESENT) || (pde & PG_SIZE))
+    return 0;
+
+  return ((u32 const*)(pde & ~(PTE_SIZE - 1)))[(vaddr >> FRAME_SHIFT) % PGTBL_LEN];
+}
+
+/* unmap_user_page
+ * Description: Takes a 4KB page out of a process' address space
+ * Inputs: proc -- process to unmap it from
+ *         vaddr -- page-aligned user address mapped with map_user_page
+ * Outputs: None
+ * Return Value: physical address of the frame that was mapped there, 0 if none was
+ * Function: The caller frees the frame; the page table stays until the process exits
+ */
+u32 unmap_user_page(u8 const proc, u32 const vaddr) {
+  u32 const* const dir = proc < NUM_PROC ? task_pgdir[proc] : NULL;
+  u32 flags, pde, frame = 0;
+  u32* pte;
+
+  if (!dir)
+    return 0;
+
+  cli_and_save(flags);
+
+  pde = dir[vaddr >> PG_4M_ADDR_OFFSET];
+  if ((pde & PG_PRESENT) && !(pde & PG_SIZE)) {
+    pte = &((u32*)(pde & ~(PTE_SIZE - 1)))[(vaddr >> FRAME_SHIFT) % PGTBL_LEN];
+
+    if (*pte & PG_PRESENT) {
+      frame = *pte & ~(PTE_SIZE - 1);
+      *pte = 0;
+
+      if (get_cr3() == (u32)dir)
+        invlpg(vaddr);
+    }
+  }
+
+  restore_flags(flags);
+  return frame;
+}
+
+/* free_private
+ * Description: Frees the pages a process owns in a range of its address space
+ * Inputs: dir -- page directory of the process that is exiting, not loaded
+ *         start_pg -- first page directory entry of the range
+ *         end_pg -- page directory entry just past it
+ * Outputs: None
+ * Return Value: none
+ * Function: Copy-on-write pages are skipped, since the image cache owns them. The page tables
+ *           are left for remove_task_pgdir.
+ */
+static void free_private(u32 const* const dir, u32 const start_pg, u32 const end_pg) {
+  u32 i, j;
+
+  for (i = start_pg; i < end_pg; ++i) {
+    u32 const* const table = (u32 const*)(dir[i] & ~(PTE_SIZE - 1));
+
+    if (!(dir[i] & PG_PRESENT) || (dir[i] & PG_SIZE))
+      continue;
+
+    for (j = 0; j < PGTBL_LEN; ++j)
+      if ((table[j] & PG_PRESENT) && !(table[j] & PG_COW))
+        frame_free(table[j] & ~(PTE_SIZE - 1));
+  }
+}
+
 /* flush_tlb
  * Description: Bit of a misnomer -- it loads the current PCBs paging details, which in turn flushes
  * the TLB Inputs: void Outputs: None Return Value: none
  */
-void flush_tlb(void) { asm volatile("mov %0, %%cr3;" ::"g"(pgdir[(get_current_pcb())->pid])); }
+void flush_tlb(void) { set_cr3(get_pgdir((u8)get_current_pcb()->pid)); }
+
+/* get_cr3
+ * Description: Reads CR3
+ * Inputs: none
+ * Outputs: none
+ * Return Value: physical address of the loaded page directory
+ * Function: Page directories are identity mapped, so this doubles as a pointer to it
+ */
+static u32 get_cr3(void) {
+  u32 cr3;
+
+  asm volatile("mov %%cr3, %0" : "=r"(cr3));
+  return cr3;
+}
+
+/* load_pgdir
+ * Description: Switches to a process' address space
+ * Inputs: proc -- process whose page directory to load
+ * Outputs: None
+ * Return Value: none
+ * Function: Writing CR3 flushes the TLB, so it is skipped if the page directory is already loaded
+ */
+void load_pgdir(u8 const proc) {
+  u32 const* const dir = get_pgdir(proc);
+
+  if (get_cr3() != (u32)dir)
+    set_cr3(dir);
+}
+
+/* set_cr3
+ * Description: Loads a page directory
+ * Inputs: dir -- page directory, by its physical (identity or direct mapped) address
+ * Outputs: None
+ * Return Value: none
+ * Function: Flushes every non-global translation, even if dir was already loaded
+ */
+static void set_cr3(u32 const* const dir) { asm volatile("mov %0, %%cr3;" ::"r"(dir) : "memory"); }
+
+/* get_pgdir
+ * Description: Finds the page directory to run a process in
+ * Inputs: proc -- process id
+ * Outputs: None
+ * Return Value: its page directory, or the kernel's if it has none
+ * Function: Before the first process starts, and between one process exiting and the next being
+ *           loaded, only the kernel's mappings are needed
+ */
+static u32 const* get_pgdir(u8 const proc) {
+  return proc < NUM_PROC && task_pgdir[proc] ? task_pgdir[proc] : pgdir;
+}
@@ -4,6 +4,7 @@
 #define PGDIR_LEN_MCR 1024
 #define PGTBL_LEN_MCR 1024
 #define PTE_SIZE_MCR 4096
+#define STACK_PG_MCR 0x29 /* STACK_PG, for the assembly that sets up the user stack */
 
 #ifndef ASM
 
@@ -19,17 +20,50 @@ enum {
   PG_PRESENT = 1,
   PG_RW = 1 << 1,
   PG_USPACE = 1 << 2,
+  PG_PWT = 1 << 3,
+  PG_PCD = 1 << 4,
   PG_SIZE = 1 << 7,
+  PG_GLOBAL = 1 << 8, /* Survives CR3 loads; only for mappings every address space shares */
+  PG_COW = 1 << 9,    /* Available to software: read-only page shared with the image cache */
+  CR0_WP = 1 << 16,   /* Read-only pages are read-only to the kernel too */
+  PG_PAT_WC = PG_PWT, /* PWT alone picks PAT entry 1, which init_pat makes write-combining */
+  MSR_PAT = 0x277,
+  PAT_WC = 0x01,
+  PAT_ENTRY_BITS = 8,
+  CPUID_EDX_PAT = 1 << 16,
+  CR4_PSE = 1 << 4,
+  CR4_PGE = 1 << 7,
   PG_4M_START = 1 << PG_4M_ADDR_OFFSET,
   ELF_LOAD_PG = 0x20,
+  SHM_PG = ELF_LOAD_PG + 1,        /* 4MB window right above the program image for shared memory */
+  HEAP_PG = SHM_PG + 1,            /* sbrk grows the heap up from here, in 4KB pages, */
+  HEAP_END_PG = STACK_PG_MCR - 1,  /* to just below the vidmap page at 160MB */
+  STACK_PG = STACK_PG_MCR,         /* User stack at 164MB, growing down from the top of this 4MB */
+  DIRECT_MAP_START_PG = 2,         /* Physical 8MB up to user space is mapped 1:1, kernel-only, */
+  DIRECT_MAP_END_PG = ELF_LOAD_PG, /* in every address space; the frame allocator hands it out */
+  APIC_PG = 0x3FB,                 /* 0xFEC00000: I/O APIC and local APIC registers, uncached */
   NUM_PROC = 8
 };
 
 /* Enable paging and setup page directory and page table */
 void init_paging(void);
+void init_pat(void);
 i32 make_task_pgdir(u8 proc);
 i32 remove_task_pgdir(u8 proc);
 i32 map_vid_mem(u8 const proc, u32 virtual_address, u32 physical_address);
+i32 map_user_page(u8 proc, u32 vaddr, u32 frame, u32 flags);
+u32 get_user_pte(u8 proc, u32 vaddr);
+u32 unmap_user_page(u8 proc, u32 vaddr);
 void flush_tlb(void);
+void load_pgdir(u8 proc);
+
+/* invlpg
+ * Description: Drops one page's translation from the TLB
+ * Inputs: addr -- any virtual address in the page
+ * Outputs: None
+ * Return Value: none
+ * Function: Works on global pages too, unlike a CR3 load
+ */
+static inline void invlpg(u32 const addr) { asm volatile("invlpg (%0)" ::"r"(addr) : "memory"); }
 #endif
 #endif
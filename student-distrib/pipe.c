@@ -0,0 +1,280 @@
+#include "pipe.h"
+#include "kmalloc.h"
+#include "lib.h"
+#include "signal.h"
+#include "syscall.h"
+
+static KmemCache* pipe_cache;
+
+static Pipe* get_fd_pipe(i32 fd);
+static void pipe_put(Pipe* p);
+
+/* get_fd_pipe
+ * Description: Gets the pipe behind one of the current process' descriptors
+ * Inputs: fd -- descriptor of either end
+ * Outputs: none
+ * Return Value: the pipe
+ * Function: The pipe's address is kept in the descriptor's inode field
+ */
+static Pipe* get_fd_pipe(i32 const fd) { return (Pipe*)get_current_pcb()->fds[fd].inode; }
+
+/* pipe_put
+ * Description: Frees a pipe once both of its ends are closed
+ * Inputs: p -- pipe that just lost a reference, with interrupts off
+ * Outputs: none
+ * Return Value: none
+ * Function: Nobody can be waiting on it any more, since every descriptor is gone
+ */
+static void pipe_put(Pipe* const p) {
+  if (p->readers || p->writers)
+    return;
+
+  kfree(p->buf);
+  kmem_cache_free(pipe_cache, p);
+}
+
+/* init_pipes
+ * Description: Sets up the cache pipes are allocated from
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Must come after init_kmalloc
+ */
+void init_pipes(void) { pipe_cache = kmem_cache_create("pipe", sizeof(Pipe)); }
+
+/* pipe_create
+ * Description: Allocates a pipe with one reader and one writer
+ * Inputs: handle -- where to store the pipe's handle, for the descriptors' inode fields
+ * Outputs: none
+ * Return Value: 0 on success, -1 if memory is full
+ * Function: The pipe comes from its slab cache and the buffer from kmalloc; the caller fills in a
+ *           descriptor for each end
+ */
+i32 pipe_create(u32* const handle) {
+  Pipe* const p = kmem_cache_alloc(pipe_cache);
+
+  if (!p)
+    return -1;
+
+  if (!(p->buf = kmalloc(PIPE_BUF_SIZE))) {
+    kmem_cache_free(pipe_cache, p);
+    return -1;
+  }
+
+  p->head = 0;
+  p->tail = 0;
+  p->readers = 1;
+  p->writers = 1;
+  init_wait_queue(&p->read_wait);
+  init_wait_queue(&p->write_wait);
+
+  *handle = (u32)p;
+  return 0;
+}
+
+/* pipe_get
+ * Description: Takes another reference to one end of a pipe
+ * Inputs: handle -- pipe handle from pipe_create
+ *         write_end -- 1 for the write end, 0 for the read end
+ * Outputs: none
+ * Return Value: none
+ * Function: Called when a descriptor is duplicated into another process
+ */
+void pipe_get(u32 const handle, u8 const write_end) {
+  Pipe* const p = (Pipe*)handle;
+  u32 flags;
+
+  cli_and_save(flags);
+
+  if (write_end)
+    ++p->writers;
+  else
+    ++p->readers;
+
+  restore_flags(flags);
+}
+
+/* pipe_open
+ * Description: Pipes can't be opened by name
+ * Inputs: filename (UNUSED)
+ * Outputs: none
+ * Return Value: -1
+ * Function: Pipe descriptors only come from the pipe system call
+ */
+i32 pipe_open(u8 const* UNUSED(filename)) { return -1; }
+
+/* pipe_read
+ * Description: Reads from a pipe, waiting for data if it is empty
+ * Inputs: fd -- read end
+ *         buf -- buffer to copy into
+ *         nbytes -- most bytes to read
+ * Outputs: none
+ * Return Value: bytes read, 0 once every writer is gone and the pipe is drained, -1 if a signal
+ *               interrupted the wait or the descriptor is non-blocking and the pipe is empty
+ * Function: Returns whatever is buffered instead of waiting for all nbytes, then wakes writers
+ */
+i32 pipe_read(i32 const fd, void* const buf, i32 const nbytes) {
+  u32 flags, avail, cnt, off, chunk;
+  Pipe* const p = get_fd_pipe(fd);
+
+  if (nbytes <= 0)
+    return 0;
+
+  cli_and_save(flags);
+
+  while (p->head == p->tail) {
+    if (!p->writers) {
+      restore_flags(flags);
+      return 0;
+    }
+
+    if (fd_nonblocking(fd) || signal_pending(get_current_pcb()->pid)) {
+      restore_flags(flags);
+      return -1;
+    }
+
+    wait_on(&p->read_wait);
+  }
+
+  avail = p->head - p->tail;
+  cnt = MIN(avail, (u32)nbytes);
+  off = p->tail & (PIPE_BUF_SIZE - 1);
+  chunk = MIN(cnt, PIPE_BUF_SIZE - off);
+
+  /* The data may wrap around the end of the buffer */
+  memcpy(buf, p->buf + off, chunk);
+  memcpy((u8*)buf + chunk, p->buf, cnt - chunk);
+  p->tail += cnt;
+
+  wake_up(&p->write_wait);
+  restore_flags(flags);
+
+  return (i32)cnt;
+}
+
+/* pipe_write
+ * Description: Writes to a pipe, waiting for room if it is full
+ * Inputs: fd -- write end
+ *         buf -- data to copy in
+ *         nbytes -- number of bytes to write
+ * Outputs: none
+ * Return Value: bytes written, or -1 if nothing could be written because every reader is gone,
+ *               a signal arrived, or the descriptor is non-blocking and the pipe is full
+ * Function: Copies as much as fits, wakes readers, and repeats until everything is written
+ */
+i32 pipe_write(i32 const fd, void const* const buf, i32 const nbytes) {
+  u32 flags, done = 0;
+  Pipe* const p = get_fd_pipe(fd);
+
+  if (nbytes <= 0)
+    return 0;
+
+  cli_and_save(flags);
+
+  while (done < (u32)nbytes) {
+    u32 space, cnt, off, chunk;
+
+    if (!p->readers)
+      break;
+
+    if (p->head - p->tail == PIPE_BUF_SIZE) {
+      if (fd_nonblocking(fd) || signal_pending(get_current_pcb()->pid))
+        break;
+
+      wait_on(&p->write_wait);
+      continue;
+    }
+
+    space = PIPE_BUF_SIZE - (p->head - p->tail);
+    cnt = MIN(space, (u32)nbytes - done);
+    off = p->head & (PIPE_BUF_SIZE - 1);
+    chunk = MIN(cnt, PIPE_BUF_SIZE - off);
+
+    memcpy(p->buf + off, (u8 const*)buf + done, chunk);
+    memcpy(p->buf, (u8 const*)buf + done + chunk, cnt - chunk);
+    p->head += cnt;
+    done += cnt;
+
+    wake_up(&p->read_wait);
+  }
+
+  restore_flags(flags);
+
+  return done ? (i32)done : -1;
+}
+
+/* pipe_read_close
+ * Description: Drops a reference to a pipe's read end
+ * Inputs: fd -- read end
+ * Outputs: none
+ * Return Value: 0
+ * Function: Writers blocked on a full pipe are woken so they can see the reader is gone; the pipe
+ *           is freed if this was its last reference
+ */
+i32 pipe_read_close(i32 const fd) {
+  u32 flags;
+  Pipe* const p = get_fd_pipe(fd);
+
+  cli_and_save(flags);
+
+  if (p->readers && !--p->readers)
+    wake_up(&p->write_wait);
+
+  pipe_put(p);
+  restore_flags(flags);
+  return 0;
+}
+
+/* pipe_write_close
+ * Description: Drops a reference to a pipe's write end
+ * Inputs: fd -- write end
+ * Outputs: none
+ * Return Value: 0
+ * Function: Once the last writer is gone, readers are woken to see end-of-file; the pipe is freed
+ *           if this was its last reference
+ */
+i32 pipe_write_close(i32 const fd) {
+  u32 flags;
+  Pipe* const p = get_fd_pipe(fd);
+
+  cli_and_save(flags);
+
+  if (p->writers && !--p->writers)
+    wake_up(&p->read_wait);
+
+  pipe_put(p);
+  restore_flags(flags);
+  return 0;
+}
+
+/* pipe_read_poll
+ * Description: Reports whether a pipe read would block
+ * Inputs: fd -- read end
+ *         pt -- poll table to register on
+ * Outputs: none
+ * Return Value: POLL_IN if there is data or end-of-file, 0 otherwise
+ * Function: Registers on the pipe's read queue
+ */
+i32 pipe_read_poll(i32 const fd, PollTable* const pt) {
+  Pipe* const p = get_fd_pipe(fd);
+
+  poll_wait(&p->read_wait, pt);
+
+  return (p->head != p->tail || !p->writers) ? POLL_IN : 0;
+}
+
+/* pipe_write_poll
+ * Description: Reports whether a pipe write would block
+ * Inputs: fd -- write end
+ *         pt -- poll table to register on
+ * Outputs: none
+ * Return Value: POLL_OUT if there is room or no reader is left (so the write fails), 0 otherwise
+ * Function: Registers on the pipe's write queue
+ */
+i32 pipe_write_poll(i32 const fd, PollTable* const pt) {
+  Pipe* const p = get_fd_pipe(fd);
+
+  poll_wait(&p->write_wait, pt);
+
+  return (p->head - p->tail < PIPE_BUF_SIZE || !p->readers) ? POLL_OUT : 0;
+}
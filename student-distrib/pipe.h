@@ -0,0 +1,34 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "types.h"
+#include "wait.h"
+
+enum {
+  PIPE_BUF_SIZE = 0x1000 /* One page; must be a power of 2 */
+};
+
+/* Ring buffer between a pipe's write end and its read end */
+typedef struct Pipe {
+  u32 head; /* Total bytes written; only the low bits index the buffer */
+  u32 tail; /* Total bytes read */
+  u32 readers;
+  u32 writers;
+  WaitQueue read_wait;
+  WaitQueue write_wait;
+  u8* buf; /* PIPE_BUF_SIZE bytes from kmalloc */
+} Pipe;
+
+void init_pipes(void);
+i32 pipe_create(u32* handle);
+void pipe_get(u32 handle, u8 write_end);
+
+i32 pipe_open(u8 const* filename);
+i32 pipe_read(i32 fd, void* buf, i32 nbytes);
+i32 pipe_write(i32 fd, void const* buf, i32 nbytes);
+i32 pipe_read_close(i32 fd);
+i32 pipe_write_close(i32 fd);
+i32 pipe_read_poll(i32 fd, PollTable* pt);
+i32 pipe_write_poll(i32 fd, PollTable* pt);
+
+#endif
@@ -1,14 +1,49 @@
 #include "pit.h"
+#include "acct.h"
+#include "apic.h"
 #include "debug.h"
+#include "fpu.h"
 #include "i8259.h"
 #include "keyboard.h"
+#include "spinlock.h"
 #include "syscall.h"
 #include "terminal_driver.h"
+#include "timer.h"
+#include "vm.h"
 #include "x86_desc.h"
 
-u8 current_schedule, schedule_counter;
+u8 current_schedule;
+
+/* Protects the run queues */
+static Spinlock sched_lock;
+
+/* Ticks the running task has used of its quantum */
+static u32 quantum_ticks;
+
+/* Whether the PIT is in one-shot mode, and for how many ticks it was programmed */
+static u8 nohz;
+static u32 nohz_ticks;
+
+/* Counts spent in one-shot mode that don't add up to a whole tick yet */
+static u32 nohz_partial;
+
+/* Ticks until every task's priority is reset */
+static u32 boost_ticks;
+
+/* Runnable tasks other than the one on the CPU, one queue per priority level */
+static RunQueue run_queues[NUM_PRIO_LEVELS];
 
 void scheduler_vidmap(u8 num_term, u32 pid);
+static Pcb* pick_next_task(void);
+static void start_shell(void);
+static i32 higher_prio_ready(u8 prio);
+static void boost_all(void);
+static void pit_set_periodic(void);
+static void pit_set_oneshot(u16 count);
+static u16 pit_read_count(void);
+static u32 tick_counts(void);
+static void tick_set_periodic(void);
+static u32 tick_oneshot_left(void);
 
 /* init_pit
  * Description: Initialize the PIT
@@ -16,41 +51,47 @@ void scheduler_vidmap(u8 num_term, u32 pid);
  * Outputs: none
  * Return Value: none
  * Function: Sets the PIT frequency so that it interrupts at a consistant rate
- * Reference: https://wiki.osdev.org/PIT#Mode_0_.E2.80.93_Interrupt_On_Terminal_Count
  */
 void init_pit(void) {
-
-  /* Get reload value (1193182 / reload_value HZ) */
-  u16 frequency = (PIT_FREQ * SCHEDULE_TIME / MS_IN_SEC);
+  u32 i;
 
   /* Enable irq for the pit */
   enable_irq(PIT_IRQ);
 
-  /* Mask high and low bits of frequency */
-  u8 low = (u8)(frequency & LOWER_BYTE_MASK);
-  u8 high = (u8)(frequency >> UPPER_BYTE_SHIFT);
-
-  /* Set PIT Modes, written to the pit register */
-  outb(PIT_SET_CHANNEL_0 | PIT_SET_ACCESS_MODE_3 | PIT_SET_MODE_RATE | PIT_SET_BCD_MODE_0,
-       PIT_MODE_REGISTER);
-  /* Write data to the pit */
-  outb(low, PIT_CHANNEL_0);
-  outb(high, PIT_CHANNEL_0);
+  pit_set_periodic();
+  nohz = 0;
+  nohz_partial = 0;
 
   /* Initialize schedule */
   current_schedule = 0;
-  schedule_counter = 0;
+  quantum_ticks = 0;
+  boost_ticks = 0;
+
+  spin_init(&sched_lock, "sched");
+
+  /* on_rq is left alone when a pid is reused, since a stale queue entry may still name it */
+  for (i = 0; i < NUM_PRIO_LEVELS; ++i)
+    rq_init(&run_queues[i]);
+  for (i = 0; i < MAX_PID_COUNT; ++i)
+    get_pcb(i)->on_rq = 0;
 }
 
 /* irqh_pit
- * Description: pit interrupt handler -- Executes next program in the schedule
- * Inputs: none
+ * Description: pit interrupt handler -- Advances the timer wheel and preempts the running task
+ * Inputs: ctx -- registers of whatever the tick interrupted
  * Outputs: none
  * Return Value: none
- * Function: Iterates through scheduler to find next program to run
+ * Function: Runs expired timers every tick. Calls the scheduler once the running task has used up
+ *           its quantum, demoting it a priority level, or as soon as a higher priority task is
+ *           runnable. Periodically resets every task's priority so nothing starves. When the
+ *           running task is the only runnable one, switches to one-shot mode. Also charges the
+ *           running task for the time since its last accounting event.
  */
-void irqh_pit(void) {
-  u32 esp, ebp;
+void irqh_pit(HwContext* const ctx) {
+  Pcb* const pcb = get_current_pcb();
+
+  /* This is where a task running in user mode stops being charged for user time */
+  acct_charge(pcb, !!(ctx->cs & DPL3));
 
   // Do paging and video mem switching if there was a terminal we previously we're asked to switch
   // to
@@ -59,75 +100,565 @@ void irqh_pit(void) {
     terminal_to_switch_to = -1;
   }
 
-  /* Iterates through the terminals until a running one is found */
-  do {
-    schedule_counter++;
-    schedule_counter %= TERMINAL_NUM;
-  } while (terminals[schedule_counter].status != TASK_RUNNING);
+  /* Catch the timer wheel up on the ticks a one-shot skipped */
+  tick_nohz_stop();
+
+  /* Wake up anything whose deadline has passed */
+  run_timers();
+
+  send_eoi(PIT_IRQ);
+
+  if (++boost_ticks >= PRIO_BOOST_TICKS) {
+    boost_all();
+    boost_ticks = 0;
+  }
+
+  /* A task that uses its whole quantum is CPU-bound: it drops a level and gets a longer quantum */
+  if (++quantum_ticks >= sched_quantum(pcb->prio)) {
+    if (pcb->prio + 1 < NUM_PRIO_LEVELS)
+      ++pcb->prio;
+  } else if (!higher_prio_ready(pcb->prio)) {
+    /* Nothing else is runnable, so nothing to preempt for: stop ticking until a timer is due */
+    if (!higher_prio_ready(NUM_PRIO_LEVELS))
+      tick_nohz_start();
+    return;
+  }
+
+  schedule();
+}
+
+/* pit_set_periodic
+ * Description: Puts the PIT back into rate mode at PIT_HZ
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Writes the mode and the reload value
+ */
+static void pit_set_periodic(void) {
+  /* Set PIT Modes, written to the pit register */
+  outb(PIT_SET_CHANNEL_0 | PIT_SET_ACCESS_MODE_3 | PIT_SET_MODE_RATE | PIT_SET_BCD_MODE_0,
+       PIT_MODE_REGISTER);
+  /* Write data to the pit, low byte then high byte */
+  outb(PIT_RELOAD & LOWER_BYTE_MASK, PIT_CHANNEL_0);
+  outb(PIT_RELOAD >> UPPER_BYTE_SHIFT, PIT_CHANNEL_0);
+}
+
+/* pit_set_oneshot
+ * Description: Makes the PIT interrupt once after a number of counts
+ * Inputs: count -- counts until the interrupt
+ * Outputs: none
+ * Return Value: none
+ * Function: Mode 0 raises OUT (and the IRQ) when the count reaches zero, then keeps counting down
+ *           without interrupting again
+ * Reference: https://wiki.osdev.org/PIT#Mode_0_.E2.80.93_Interrupt_On_Terminal_Count
+ */
+static void pit_set_oneshot(u16 const count) {
+  outb(PIT_SET_CHANNEL_0 | PIT_SET_ACCESS_MODE_3 | PIT_SET_MODE_TERMINAL_COUNT |
+           PIT_SET_BCD_MODE_0,
+       PIT_MODE_REGISTER);
+  outb(count & LOWER_BYTE_MASK, PIT_CHANNEL_0);
+  outb(count >> UPPER_BYTE_SHIFT, PIT_CHANNEL_0);
+}
+
+/* pit_read_count
+ * Description: Reads how many counts channel 0 has left
+ * Inputs: none
+ * Outputs: none
+ * Return Value: current count
+ * Function: Latches the count so both bytes come from the same instant
+ */
+static u16 pit_read_count(void) {
+  u16 low;
+
+  /* Channel 0 latch command */
+  outb(PIT_SET_CHANNEL_0, PIT_MODE_REGISTER);
+  low = (u16)inb(PIT_CHANNEL_0);
+  return low | (u16)(inb(PIT_CHANNEL_0) << UPPER_BYTE_SHIFT);
+}
+
+/* tick_counts
+ * Description: Gets how many counts of the timer driving the tick make up one tick
+ * Inputs: none
+ * Outputs: none
+ * Return Value: counts per tick
+ * Function: The local APIC timer drives the tick once init_apic_irqs switches to it; until then,
+ *           or without an APIC, the PIT does
+ */
+static u32 tick_counts(void) { return apic_irqs_enabled() ? get_lapic_tick_count() : PIT_RELOAD; }
+
+/* tick_set_periodic
+ * Description: Makes the timer driving the tick interrupt every tick
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Reprograms whichever timer tick_counts describes
+ */
+static void tick_set_periodic(void) {
+  if (apic_irqs_enabled())
+    lapic_timer_periodic(get_lapic_tick_count());
+  else
+    pit_set_periodic();
+}
+
+/* tick_oneshot_left
+ * Description: Reads how much of a one-shot is left
+ * Inputs: none
+ * Outputs: none
+ * Return Value: counts left, 0 once it went off
+ * Function: The PIT keeps counting past zero in mode 0, so its output pin says whether it fired
+ */
+static u32 tick_oneshot_left(void) {
+  if (apic_irqs_enabled())
+    return lapic_timer_remaining();
+
+  outb(PIT_READ_BACK | PIT_READ_BACK_STATUS | PIT_READ_BACK_CHANNEL_0, PIT_MODE_REGISTER);
+  if (inb(PIT_CHANNEL_0) & PIT_STATUS_OUT)
+    return 0;
+
+  return pit_read_count();
+}
+
+/* tick_nohz_start
+ * Description: Stops the periodic tick while nothing needs it
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Called when at most one task can run, so there's nothing to preempt. Programs a
+ *           one-shot for the next tick a timer could be due on, as far out as the counter allows.
+ *           Must be called with interrupts off.
+ */
+void tick_nohz_start(void) {
+  u32 const counts = tick_counts();
+  u32 n;
+
+  tick_nohz_stop();
+
+  /* The local APIC timer's counter is 32 bits, the PIT's only 16 */
+  n = next_timer_tick(get_ticks() + (apic_irqs_enabled() ? 0xFFFFFFFF / counts : NOHZ_MAX_TICKS)) -
+      get_ticks();
+
+  /* Not worth switching modes for */
+  if ((i32)n <= 1)
+    return;
+
+  if (apic_irqs_enabled())
+    lapic_timer_oneshot(n * counts);
+  else
+    pit_set_oneshot((u16)(n * counts));
+
+  nohz_ticks = n;
+  nohz = 1;
+}
+
+/* tick_nohz_stop
+ * Description: Restarts the periodic tick
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Works out how many ticks passed since tick_nohz_start from the counter and runs the
+ *           timer wheel for them, so get_ticks is accurate again. The part of a tick left over is
+ *           carried into the next stop, so many short idle periods still add up to the right
+ *           number of ticks. If the one-shot already went off, its interrupt is still on the way
+ *           and accounts for the last tick. Called whenever something may need the CPU sooner: a
+ *           task became runnable, a timer was added, or the displayed terminal changes. Must be
+ *           called with interrupts off.
+ */
+void tick_nohz_stop(void) {
+  u32 const counts = tick_counts();
+  u32 left, elapsed;
+
+  if (!nohz)
+    return;
+
+  nohz = 0;
+
+  if ((left = tick_oneshot_left())) {
+    nohz_partial += nohz_ticks * counts - left;
+    elapsed = nohz_partial / counts;
+    nohz_partial %= counts;
+  } else {
+    elapsed = nohz_ticks - 1;
+  }
+
+  tick_set_periodic();
+
+  while (elapsed--)
+    run_timers();
+}
+
+/* schedule
+ * Description: Switches to the next runnable task
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Queues the current task if it can still run, then starts a shell on any terminal that
+ *           has been switched to but has none yet. Otherwise takes the next task off the run queue
+ *           and switches stacks to it with switch_to, mapping video memory for the task's terminal
+ *           and loading its page directory. Returns straight away if nothing else can run.
+ */
+void schedule(void) {
+  Pcb* const prev_pcb = get_current_pcb();
+  Pcb* next_pcb;
+  u8 i;
+
+  quantum_ticks = 0;
+
+  /* The task we're switching away from goes to the back of the line if it can still run */
+  if (prev_pcb->state == TASK_RUNNING)
+    enqueue_task(prev_pcb->pid);
+
+  /* If a terminal is not running start the shell, leaving this task resumable */
+  for (i = 0; i < TERMINAL_NUM; ++i) {
+    if (terminals[i].status != TASK_RUNNING || terminals[i].running)
+      continue;
 
-  /* If this schedule is the current schedule we can continue to run it */
-  if (schedule_counter == current_schedule) {
-    send_eoi(PIT_IRQ);
+    current_schedule = i;
+    acct_switch(prev_pcb, NULL);
+    switch_to_call(&prev_pcb->ksp, start_shell);
+
+    /* We've been switched back to (or the shell failed to start) */
+    current_schedule = prev_pcb->term;
     return;
   }
 
-  /* Set the current schedule to the schedule_counter */
-  current_schedule = schedule_counter;
+  /* If nothing else is runnable we can continue to run this task */
+  if (!(next_pcb = pick_next_task()) || next_pcb == prev_pcb)
+    return;
+
+  /* Set the current schedule to the next task's terminal */
+  current_schedule = next_pcb->term;
 
-  Pcb* prev_pcb = get_current_pcb();
+  /* Setup the TSS to switch to the next pid and set the running pid*/
+  tss.esp0 = MB8 - KB8 * (next_pcb->pid + 1) - ADDRESS_SIZE;
+  set_pid(next_pcb->pid);
 
-  /* Save the ESP and EBP so this process is still reachable */
-  asm volatile("mov %%esp, %0;"
-               "mov %%ebp, %1;"
-               : "=g"(esp), "=g"(ebp));
+  /* These edit the next task's page tables, which aren't loaded yet, so nothing is flushed */
+  if (terminals[current_schedule].vidmap)
+    scheduler_vidmap(current_schedule, next_pcb->pid);
+
+  /* If the terminal is the current one map video memory to the physical address.
+   * Otherwise it should not be displayed and set it to the address of the buffer */
+  if (current_schedule == current_terminal) {
+    map_vid_mem(next_pcb->pid, (u32)VIDEO, (u32)VIDEO);
+  } else {
+    map_vid_mem(next_pcb->pid, (u32)VIDEO, (u32)(terminals[current_schedule].vid_mem_buf));
+  }
 
-  /* Save esp and ebp to the ksp and kbp */
-  prev_pcb->ksp = esp;
-  prev_pcb->kbp = ebp;
+  /* The one CR3 load of the switch */
+  load_pgdir(next_pcb->pid);
 
-  if (terminals[current_schedule].running == 1) {
-    /* If the terminal is running get the next pcb */
-    Pcb* next_pcb = get_pcb(terminals[current_schedule].pid);
+  /* FPU state follows lazily, on next's first FPU instruction */
+  fpu_switch_to(next_pcb);
 
-    /* find the lowest child pcb */
-    while (next_pcb->child_pcb) {
-      next_pcb = next_pcb->child_pcb;
+  acct_switch(prev_pcb, next_pcb);
+
+  /* Switch to the next program in the scheduler to run */
+  switch_to(&prev_pcb->ksp, next_pcb->ksp);
+}
+
+/* start_shell
+ * Description: Starts a terminal's first shell on behalf of the scheduler
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Only returns if the shell couldn't be executed
+ */
+static void start_shell(void) { execute((u8*)"shell"); }
+
+/* pick_next_task
+ * Description: Chooses the task to run after the current one
+ * Inputs: none
+ * Outputs: none
+ * Return Value: pcb of the next runnable task (possibly the current one), NULL if none is runnable
+ * Function: Takes the head of the highest priority non-empty run queue. Entries whose task stopped
+ *           being runnable while queued (or whose pid was freed) are dropped on the way. Must be
+ *           called with interrupts off.
+ */
+static Pcb* pick_next_task(void) {
+  Pcb* pcb;
+  i32 pid;
+  u32 i;
+
+  spin_lock(&sched_lock);
+
+  for (i = 0; i < NUM_PRIO_LEVELS; ++i)
+    while ((pid = rq_pop(&run_queues[i])) != -1) {
+      pcb = get_pcb((u8)pid);
+      pcb->on_rq = 0;
+
+      if (get_task((u32)pid) && pcb->state == TASK_RUNNING) {
+        spin_unlock(&sched_lock);
+        return pcb;
+      }
     }
 
-    /* Setup the TSS to switch to the next pid and set the running pid*/
-    tss.esp0 = MB8 - KB8 * (next_pcb->pid + 1) - ADDRESS_SIZE;
-    set_pid(next_pcb->pid);
+  spin_unlock(&sched_lock);
+
+  return NULL;
+}
+
+/* higher_prio_ready
+ * Description: Checks whether something should preempt a task before its quantum is up
+ * Inputs: prio -- priority level of the running task
+ * Outputs: none
+ * Return Value: 1 if a higher priority queue has an entry, 0 otherwise
+ * Function: Entries may be stale; the worst case is one extra call to schedule
+ */
+static i32 higher_prio_ready(u8 const prio) {
+  u32 i;
+
+  for (i = 0; i < prio; ++i)
+    if (run_queues[i].cnt)
+      return 1;
+
+  return 0;
+}
+
+/* boost_all
+ * Description: Moves every task back to its highest allowed priority
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Keeps CPU-bound tasks that sank to the bottom level from starving, and lets tasks that
+ *           turned interactive recover. Queued tasks are moved to their new level's queue.
+ */
+static void boost_all(void) {
+  RunQueue queued;
+  Pcb* pcb;
+  i32 pid;
+  u32 i;
+
+  for (i = 0; i < MAX_PID_COUNT; ++i)
+    if ((pcb = get_task(i)))
+      pcb->prio = pcb->nice;
+
+  spin_lock(&sched_lock);
+
+  rq_init(&queued);
+  for (i = 0; i < NUM_PRIO_LEVELS; ++i)
+    while ((pid = rq_pop(&run_queues[i])) != -1)
+      rq_push(&queued, (u8)pid);
+
+  while ((pid = rq_pop(&queued)) != -1) {
+    pcb = get_pcb((u8)pid);
+    pcb->rq_prio = pcb->prio;
+    rq_push(&run_queues[pcb->prio], (u8)pid);
+  }
+
+  spin_unlock(&sched_lock);
+}
+
+/* block_current
+ * Description: Gives up the CPU until the current task is made runnable again
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: The caller sets the task's state before calling this. Other tasks get the CPU in
+ *           the meantime; if none of them can run either, the idle time goes to zeroing frames
+ *           for the page fault path, and once the pool is full we halt until the next interrupt,
+ *           with the periodic tick stopped.
+ */
+void block_current(void) {
+  Pcb* const pcb = get_current_pcb();
 
-    if (terminals[current_schedule].vidmap)
-      scheduler_vidmap(current_schedule, next_pcb->pid);
+  while (pcb->state != TASK_RUNNING) {
+    schedule();
 
-    /* If the terminal is the current one map video memory to the physical address.
-     * Otherwise it should not be displayed and set it to the address of the buffer */
-    if (current_schedule == current_terminal) {
-      map_vid_mem(next_pcb->pid, (u32)VIDEO, (u32)VIDEO);
-    } else {
-      map_vid_mem(next_pcb->pid, (u32)VIDEO, (u32)(terminals[current_schedule].vid_mem_buf));
+    /* Nothing can run: zero a batch of frames, then let pending interrupts in and look again */
+    if (pcb->state != TASK_RUNNING && zero_pool_refill()) {
+      asm volatile("sti; nop; cli" ::: "memory");
+      continue;
     }
 
-    /* Flush the tlb and end the interrupt */
-    flush_tlb();
-    send_eoi(PIT_IRQ);
-
-    /* Switch to the next program in the scheduler to run */
-    asm volatile("mov %0, %%esp;"
-                 "mov %1, %%ebp;"
-                 "leave;"
-                 "ret;"
-                 :
-                 : "g"(next_pcb->ksp), "g"(next_pcb->kbp)
-                 : "esp", "ebp");
-  } else {
-    /* If the terminal is not running end the interrupt and start the shell */
-    send_eoi(PIT_IRQ);
-    execute((u8*)"shell");
+    /* Nothing to do either, so sleep without ticking until a timer or another interrupt is due */
+    if (pcb->state != TASK_RUNNING) {
+      tick_nohz_start();
+      asm volatile("sti; hlt; cli" ::: "memory");
+    }
   }
 }
 
+/* wake_task
+ * Description: Makes a blocked task runnable again
+ * Inputs: pid -- process to wake
+ * Outputs: none
+ * Return Value: none
+ * Function: Marks the task as running and queues it so the scheduler will pick it again. A task
+ *           that was blocked goes back to its highest allowed priority. Doubles as the callback for
+ *           a task's sleep timer.
+ */
+void wake_task(u32 const pid) {
+  Pcb* pcb;
+
+  if (pid >= MAX_PID_COUNT)
+    return;
+
+  pcb = get_pcb(pid);
+
+  /* Tasks that wait on the keyboard, RTC or a pipe are interactive: run them ahead of batch work */
+  if (pcb->state != TASK_RUNNING)
+    pcb->prio = pcb->nice;
+
+  pcb->state = TASK_RUNNING;
+  enqueue_task(pid);
+}
+
+/* enqueue_task
+ * Description: Puts a runnable task at the back of the run queue
+ * Inputs: pid -- process to queue
+ * Outputs: none
+ * Return Value: none
+ * Function: Does nothing if the task is already queued at its priority. If its priority changed
+ *           while it was queued (a wake up, nice, or the task's quantum running out), the old entry
+ *           is taken out first, so the task is never on two queues. Must be called with interrupts
+ *           off.
+ */
+void enqueue_task(u32 const pid) {
+  Pcb* const pcb = get_pcb((u8)pid);
+
+  spin_lock(&sched_lock);
+
+  if (pcb->on_rq && pcb->rq_prio != pcb->prio) {
+    rq_remove(&run_queues[pcb->rq_prio], (u8)pid);
+    pcb->on_rq = 0;
+  }
+
+  if (!pcb->on_rq && !rq_push(&run_queues[pcb->prio], (u8)pid)) {
+    pcb->on_rq = 1;
+    pcb->rq_prio = pcb->prio;
+  }
+
+  spin_unlock(&sched_lock);
+
+  /* Someone may have to be preempted now */
+  tick_nohz_stop();
+}
+
+/* sched_quantum
+ * Description: Gets the length of a priority level's quantum
+ * Inputs: prio -- priority level, 0 being the highest
+ * Outputs: none
+ * Return Value: quantum in PIT ticks
+ * Function: Doubles with each level down, so CPU-bound tasks switch less often
+ */
+u32 sched_quantum(u8 const prio) { return SCHEDULE_TICKS << prio; }
+
+/* sched_nice
+ * Description: Changes the current process' niceness
+ * Inputs: inc -- amount to add; positive values lower the process' priority
+ * Outputs: none
+ * Return Value: the new niceness
+ * Function: Niceness is the highest priority level the process may run at, clamped to the
+ *           available levels. The increment is clamped before it is added so a huge one can't
+ *           overflow. Spawned and executed children inherit it.
+ */
+i32 sched_nice(i32 const inc) {
+  Pcb* const pcb = get_current_pcb();
+  i32 val = (i32)pcb->nice + MAX(-NUM_PRIO_LEVELS, MIN(inc, NUM_PRIO_LEVELS));
+
+  if (val < 0)
+    val = 0;
+  else if (val >= NUM_PRIO_LEVELS)
+    val = NUM_PRIO_LEVELS - 1;
+
+  pcb->nice = (u8)val;
+  if (pcb->prio < pcb->nice)
+    pcb->prio = pcb->nice;
+
+  return val;
+}
+
+/* rq_init
+ * Description: Empties a run queue
+ * Inputs: rq -- queue to empty
+ * Outputs: none
+ * Return Value: none
+ * Function: Resets the ring buffer's head and count
+ */
+void rq_init(RunQueue* const rq) {
+  rq->head = 0;
+  rq->cnt = 0;
+}
+
+/* rq_push
+ * Description: Adds a pid to the back of a run queue
+ * Inputs: rq -- queue to add to
+ *         pid -- pid to add
+ * Outputs: none
+ * Return Value: 0 on success, -1 if the queue is full
+ * Function: Writes one slot past the last entry, wrapping around the ring buffer
+ */
+i32 rq_push(RunQueue* const rq, u8 const pid) {
+  if (rq->cnt == RUNQUEUE_SIZE)
+    return -1;
+
+  rq->pids[(rq->head + rq->cnt) % RUNQUEUE_SIZE] = pid;
+  ++rq->cnt;
+  return 0;
+}
+
+/* rq_pop
+ * Description: Takes the pid at the front of a run queue
+ * Inputs: rq -- queue to take from
+ * Outputs: none
+ * Return Value: the pid, or -1 if the queue is empty
+ * Function: Advances the head of the ring buffer
+ */
+i32 rq_pop(RunQueue* const rq) {
+  u8 pid;
+
+  if (!rq->cnt)
+    return -1;
+
+  pid = rq->pids[rq->head];
+  rq->head = (rq->head + 1) % RUNQUEUE_SIZE;
+  --rq->cnt;
+  return pid;
+}
+
+/* rq_remove
+ * Description: Takes a pid out of the middle of a run queue
+ * Inputs: rq -- queue to take it from
+ *         pid -- pid to remove
+ * Outputs: none
+ * Return Value: 0 on success, -1 if the pid isn't queued
+ * Function: Shifts the entries behind it forward one slot, keeping their order
+ */
+i32 rq_remove(RunQueue* const rq, u8 const pid) {
+  u32 i;
+
+  for (i = 0; i < rq->cnt; ++i)
+    if (rq->pids[(rq->head + i) % RUNQUEUE_SIZE] == pid)
+      break;
+
+  if (i == rq->cnt)
+    return -1;
+
+  for (; i + 1 < rq->cnt; ++i)
+    rq->pids[(rq->head + i) % RUNQUEUE_SIZE] = rq->pids[(rq->head + i + 1) % RUNQUEUE_SIZE];
+
+  --rq->cnt;
+  return 0;
+}
+
+/* get_terminal_task
+ * Description: Gets the task a terminal is currently running
+ * Inputs: term -- terminal to look at
+ * Outputs: none
+ * Return Value: pcb of the terminal's task
+ * Function: Only the lowest process in a terminal's chain can run; its parents are all waiting
+ *           in execute
+ */
+Pcb* get_terminal_task(u8 const term) {
+  Pcb* pcb = get_pcb(terminals[term].pid);
+
+  /* find the lowest child pcb */
+  while (pcb->child_pcb)
+    pcb = pcb->child_pcb;
+
+  return pcb;
+}
+
 /* get_current_schedule
  * Description: Gets the current schedule
  * Inputs: none
@@ -27,11 +27,29 @@
 #define PIT_SET_BCD_MODE_0  0x00
 #define PIT_SET_BCD_MODE_1  0x01
 
+#define PIT_READ_BACK           0xC0
+#define PIT_READ_BACK_STATUS    0x20 // Set: don't latch the count, only the status byte
+#define PIT_READ_BACK_CHANNEL_0 0x02
+#define PIT_STATUS_OUT          0x80 // Output pin; goes high once a one-shot count runs out
+
+#define PIT_GATE_PORT       0x61 // Keyboard controller port B, wired to channel 2
+#define PIT_GATE_CHANNEL_2  0x01 // Lets channel 2 count
+#define PIT_SPEAKER_ENABLE  0x02 // Routes channel 2 to the speaker
+#define PIT_OUT_CHANNEL_2   0x20 // Channel 2's output pin
+
 #define PIT_IRQ 0x0
 
 #define PIT_FREQ 1193182
-#define SCHEDULE_TIME 10 // in MS
+#define PIT_HZ 1000 // Timer tick rate, gives the timer wheel millisecond resolution
+#define PIT_RELOAD (PIT_FREQ / PIT_HZ) // Counts per tick
+#define NOHZ_MAX_TICKS (0xFFFF / PIT_RELOAD) // Longest one-shot the 16-bit counter can hold
+#define SCHEDULE_TIME 10 // in MS, quantum at the highest priority
 #define MS_IN_SEC 1000
+#define SCHEDULE_TICKS (SCHEDULE_TIME * PIT_HZ / MS_IN_SEC)
+
+#define NUM_PRIO_LEVELS 4 // Each level down doubles the quantum
+#define PRIO_BOOST_TIME 1000 // in MS, how often every task goes back to its highest priority
+#define PRIO_BOOST_TICKS (PRIO_BOOST_TIME * PIT_HZ / MS_IN_SEC)
 
 #define TASK_NOT_RUNNING        0
 #define TASK_RUNNING            1
@@ -40,11 +58,41 @@
 #define TASK_STOPPED            4
 #define TASK_ZOMBIE             5
 
+#define RUNQUEUE_SIZE 8 // One slot per pid, a task is never queued twice
+
 #define UPPER_BYTE_SHIFT 8
 #define LOWER_BYTE_MASK 0x00FF
 
-void irqh_pit(void);
+/* FIFO of runnable pids, a ring buffer so pushing and popping are O(1) */
+typedef struct RunQueue {
+  u8 pids[RUNQUEUE_SIZE];
+  u8 head;
+  u8 cnt;
+} RunQueue;
+
+/* Number of words switch_to saves below the return address (EBX, ESI, EDI, EBP) */
+#define SWITCH_FRAME_WORDS 4
+
+struct HwContext;
+void irqh_pit(struct HwContext* ctx);
 void init_pit(void);
 u8 get_current_schedule(void);
+void schedule(void);
+void block_current(void);
+void wake_task(u32 pid);
+void enqueue_task(u32 pid);
+u32 sched_quantum(u8 prio);
+void tick_nohz_start(void);
+void tick_nohz_stop(void);
+i32 sched_nice(i32 inc);
+void rq_init(RunQueue* rq);
+i32 rq_push(RunQueue* rq, u8 pid);
+i32 rq_pop(RunQueue* rq);
+i32 rq_remove(RunQueue* rq, u8 pid);
+struct Pcb* get_terminal_task(u8 term);
+
+/* switch_asm.S */
+void switch_to(u32* prev_ksp, u32 next_ksp);
+void switch_to_call(u32* prev_ksp, void (*fn)(void));
 
 #endif
@@ -2,6 +2,8 @@
 #include "i8259.h"
 #include "lib.h"
 #include "options.h"
+#include "signal.h"
+#include "syscall.h"
 
 // Global to hold RTC state for virtualization
 
@@ -55,6 +57,8 @@ void irqh_rtc(void) {
     // Basically this state doesn't matter until we get a read, then it resets the flag when we get
     // enough IRQs
     term->rtc.flag = (term->rtc.real_freq <= term->rtc.virt_freq * ++term->rtc.int_count);
+    if (term->rtc.flag)
+      wake_up(&term->rtc.wait);
   }
 
 #if RTC_RANDOM_TEXT_DEMO
@@ -65,25 +69,38 @@ void irqh_rtc(void) {
 }
 
 /* rtc_read
- * Description: Spin while waiting for the IRQH to fire at virtual freq. Then reset that flag.
- * Inputs: i32 fd, void* buf, i32 nbytes (all ignored)
+ * Description: Block until the IRQH fires at virtual freq. Then reset that flag.
+ * Inputs: i32 fd (checked for non-blocking mode), void* buf, i32 nbytes (ignored)
  * Outputs: resets the virtual flag to 0
- * Return Value: i32 (always 0), or -1 if term details are null
- * Side Effects: Blocks exectution of process while waiting for int to occur
+ * Return Value: i32 (always 0), or -1 if term details are null, a signal interrupted the wait or
+ *               the descriptor is non-blocking and no tick is pending
+ * Side Effects: Blocks exectution of process while waiting for int to occur. A tick that already
+ *               arrived since the last read (e.g. one reported by poll) is consumed immediately.
  */
-i32 rtc_read(i32 UNUSED(fd), void* UNUSED(buf), i32 UNUSED(nbytes)) {
+i32 rtc_read(i32 const fd, void* UNUSED(buf), i32 UNUSED(nbytes)) {
   terminal* term = get_running_terminal();
+  u32 flags;
   // Guard clause against function we don't own
   if (!term)
     return -1;
 
+  // Interrupts stay off between checking the flag and sleeping so we can't miss the wake up
+  cli_and_save(flags);
+
+  while (!term->rtc.flag) {
+    if (fd_nonblocking(fd) || signal_pending(get_current_pcb()->pid)) {
+      restore_flags(flags);
+      return -1;
+    }
+
+    wait_on(&term->rtc.wait);
+  }
+
   // Reset flag and inter count -- wait for IRQH to override
   term->rtc.flag = 0;
   term->rtc.int_count = 0;
 
-  while (!term->rtc.flag) {
-    // spin while we wait for flag to be set by IRQH (avoid gcc warnings with this comment)
-  }
+  restore_flags(flags);
   return 0;
 }
 
@@ -124,6 +141,24 @@ i32 rtc_open(const u8* UNUSED(filename)) {
  */
 i32 rtc_close(i32 UNUSED(fd)) { return 0; }
 
+/* rtc_poll
+ * Description: Reports whether an RTC read would block
+ * Inputs: i32 fd (ignored), PollTable* pt (table to register the RTC's queue on)
+ * Outputs: none
+ * Return Value: POLL_OUT, plus POLL_IN if a virtual interrupt is pending
+ * Side Effects: none
+ */
+i32 rtc_poll(i32 UNUSED(fd), PollTable* const pt) {
+  terminal* const term = get_running_terminal();
+
+  if (!term)
+    return POLL_OUT;
+
+  poll_wait(&term->rtc.wait, pt);
+
+  return POLL_OUT | (term->rtc.flag ? POLL_IN : 0);
+}
+
 /* ack_rtc_int
  * Description: ACKs an RTC interrupt.
  * Inputs: None
@@ -176,6 +211,7 @@ int set_virtual_freq_rtc(u32 freq) {
   }
   // We reset interrupt count to start our time-to-first-read constant
   term->rtc.int_count = 0;
+  term->rtc.flag = 0;
   term->rtc.virt_freq = freq;
   return 0;
 }
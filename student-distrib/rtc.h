@@ -35,4 +35,5 @@ i32 rtc_read(i32 fd, void* buf, i32 nbytes);
 i32 rtc_write(i32 fd, const void* buf, i32 nbytes);
 i32 rtc_open(const u8* filename);
 i32 rtc_close(i32 fd);
+i32 rtc_poll(i32 fd, PollTable* pt);
 #endif
@@ -0,0 +1,205 @@
+#include "shm.h"
+#include "frame.h"
+#include "lib.h"
+#include "paging.h"
+#include "syscall.h"
+
+static ShmSegment segments[SHM_MAX_SEGMENTS];
+
+/* Physical address of the 4MB pool, from the frame allocator; 0 if there wasn't one to spare */
+static u32 pool_base;
+
+/* One bit per pool frame, set while a segment owns it */
+static u32 pool_map[SHM_POOL_PAGES / SHM_MAP_BITS];
+
+static i32 pool_alloc(u32 npages);
+static void pool_free(u32 first, u32 npages);
+
+/* pool_alloc
+ * Description: Finds a run of free frames in the shared memory pool
+ * Inputs: npages -- number of contiguous frames wanted
+ * Outputs: none
+ * Return Value: index of the first frame, -1 if no run is long enough
+ * Function: First fit over the pool bitmap; marks the frames as used
+ */
+static i32 pool_alloc(u32 const npages) {
+  u32 start, i;
+
+  for (start = 0; start + npages <= SHM_POOL_PAGES; start = i + 1) {
+    for (i = start; i < start + npages; ++i)
+      if (pool_map[i / SHM_MAP_BITS] & (1U << (i % SHM_MAP_BITS)))
+        break;
+
+    if (i == start + npages) {
+      for (i = start; i < start + npages; ++i)
+        pool_map[i / SHM_MAP_BITS] |= 1U << (i % SHM_MAP_BITS);
+
+      return (i32)start;
+    }
+  }
+
+  return -1;
+}
+
+/* pool_free
+ * Description: Returns frames to the shared memory pool
+ * Inputs: first -- index of the first frame
+ *         npages -- number of frames
+ * Outputs: none
+ * Return Value: none
+ * Function: Clears the frames' bits in the pool bitmap
+ */
+static void pool_free(u32 const first, u32 const npages) {
+  u32 i;
+
+  for (i = first; i < first + npages; ++i)
+    pool_map[i / SHM_MAP_BITS] &= ~(1U << (i % SHM_MAP_BITS));
+}
+
+/* init_shm
+ * Description: Initializes shared memory
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Takes a 4MB frame for the pool and marks every segment and pool frame as free
+ */
+void init_shm(void) {
+  memset(segments, 0, sizeof(segments));
+  memset(pool_map, 0, sizeof(pool_map));
+  pool_base = frame_alloc_4m();
+}
+
+/* shm_create
+ * Description: Creates a shared memory segment, or finds the one already using a key
+ * Inputs: key -- name processes agree on to find the segment
+ *         size -- size in bytes, rounded up to whole pages
+ * Outputs: none
+ * Return Value: segment id on success, -1 on failure
+ * Function: New segments are zero-filled. The segment lives for as long as any process that
+ *           created or attached it is still running.
+ */
+i32 shm_create(u32 const key, u32 const size) {
+  u32 const npages = (size + SHM_PAGE_SIZE - 1) / SHM_PAGE_SIZE;
+  u32 const pid = get_current_pcb()->pid;
+  u32 flags;
+  i32 id, free_id = -1, first;
+
+  if (!size || npages > SHM_POOL_PAGES || !pool_base)
+    return -1;
+
+  cli_and_save(flags);
+
+  for (id = 0; id < SHM_MAX_SEGMENTS; ++id) {
+    if (!segments[id].users) {
+      if (free_id == -1)
+        free_id = id;
+      continue;
+    }
+
+    if (segments[id].key == key) {
+      if (npages > segments[id].npages) {
+        restore_flags(flags);
+        return -1;
+      }
+
+      segments[id].users |= 1U << pid;
+      restore_flags(flags);
+      return id;
+    }
+  }
+
+  if (free_id == -1 || (first = pool_alloc(npages)) == -1) {
+    restore_flags(flags);
+    return -1;
+  }
+
+  segments[free_id].key = key;
+  segments[free_id].first_page = (u32)first;
+  segments[free_id].npages = npages;
+  segments[free_id].users = 1U << pid;
+  segments[free_id].attached = 0;
+
+  /* Through the kernel's direct map */
+  memset((void*)(pool_base + (u32)first * SHM_PAGE_SIZE), 0, npages * SHM_PAGE_SIZE);
+
+  restore_flags(flags);
+  return free_id;
+}
+
+/* shm_attach
+ * Description: Maps a shared memory segment into the calling process
+ * Inputs: id -- segment id from shm_create
+ *         addr -- where to store the segment's user address
+ * Outputs: none
+ * Return Value: 0 on success, -1 on failure
+ * Function: Maps the segment's frames into the process' shared memory window. A segment sits at
+ *           the same address in every process, so pointers into it can be shared too.
+ */
+i32 shm_attach(i32 const id, u8** const addr) {
+  Pcb* const pcb = get_current_pcb();
+  ShmSegment* seg;
+  u32 flags, i;
+
+  if (id < 0 || id >= SHM_MAX_SEGMENTS || !addr || bad_userspace_addr(addr, sizeof(*addr)))
+    return -1;
+
+  cli_and_save(flags);
+
+  seg = &segments[id];
+  if (!seg->users) {
+    restore_flags(flags);
+    return -1;
+  }
+
+  /* The window's page table is allocated on first use; without it, undo what was mapped */
+  for (i = seg->first_page; i < seg->first_page + seg->npages; ++i)
+    if (map_user_page((u8)pcb->pid, SHM_PG * PG_4M_START + i * SHM_PAGE_SIZE,
+                      pool_base + i * SHM_PAGE_SIZE, PG_RW)) {
+      while (i-- > seg->first_page)
+        unmap_user_page((u8)pcb->pid, SHM_PG * PG_4M_START + i * SHM_PAGE_SIZE);
+
+      restore_flags(flags);
+      return -1;
+    }
+
+  seg->users |= 1U << pcb->pid;
+  seg->attached |= 1U << pcb->pid;
+
+  restore_flags(flags);
+
+  *addr = (u8*)(SHM_PG * PG_4M_START + seg->first_page * SHM_PAGE_SIZE);
+  return 0;
+}
+
+/* shm_exit
+ * Description: Drops a halting process' hold on every segment
+ * Inputs: pid -- process that is halting
+ * Outputs: none
+ * Return Value: none
+ * Function: Unmaps attached segments and frees the ones nobody else uses
+ */
+void shm_exit(u32 const pid) {
+  u32 const bit = 1U << pid;
+  u32 flags, id, i;
+
+  cli_and_save(flags);
+
+  for (id = 0; id < SHM_MAX_SEGMENTS; ++id) {
+    ShmSegment* const seg = &segments[id];
+
+    if (!(seg->users & bit))
+      continue;
+
+    if (seg->attached & bit)
+      for (i = seg->first_page; i < seg->first_page + seg->npages; ++i)
+        unmap_user_page((u8)pid, SHM_PG * PG_4M_START + i * SHM_PAGE_SIZE);
+
+    seg->users &= ~bit;
+    seg->attached &= ~bit;
+
+    if (!seg->users)
+      pool_free(seg->first_page, seg->npages);
+  }
+
+  restore_flags(flags);
+}
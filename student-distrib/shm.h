@@ -0,0 +1,26 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "types.h"
+
+enum {
+  SHM_MAX_SEGMENTS = 8,
+  SHM_POOL_PAGES = 1024, /* One 4MB pool of 4KB frames, mapped 1:1 into every window */
+  SHM_PAGE_SIZE = 0x1000,
+  SHM_MAP_BITS = 32 /* Frames tracked per word of the pool bitmap */
+};
+
+typedef struct ShmSegment {
+  u32 key;
+  u32 first_page; /* Index into the pool; also the segment's page in every process' window */
+  u32 npages;
+  u32 users;    /* Bitmask of pids that created or attached the segment */
+  u32 attached; /* Bitmask of pids that have it mapped */
+} ShmSegment;
+
+void init_shm(void);
+i32 shm_create(u32 key, u32 size);
+i32 shm_attach(i32 id, u8** addr);
+void shm_exit(u32 pid);
+
+#endif
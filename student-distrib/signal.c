@@ -0,0 +1,246 @@
+#include "signal.h"
+#include "lib.h"
+#include "pit.h"
+#include "syscall.h"
+#include "timer.h"
+#include "x86_desc.h"
+
+enum {
+  /* EFLAGS bits userspace may change through sigreturn (CF, PF, AF, ZF, SF, TF, DF, OF) */
+  EFLAGS_USER_MASK = 0x0DD5
+};
+
+/* "movl $SYSC_SIGRETURN, %eax; int $0x80; nop", copied onto the user stack as the handler's return
+ * address */
+static u8 const sigreturn_linkage[SIGRETURN_LINKAGE_SIZE] = {0xB8, SYSC_SIGRETURN, 0x00, 0x00,
+                                                             0x00, 0xCD, 0x80,           0x90};
+
+/* Signals whose default action kills the process; the rest are ignored */
+static u8 const sig_default_kill[NUM_SIGNALS] = {
+    [SIG_DIV_ZERO] = 1, [SIG_SEGFAULT] = 1, [SIG_INTERRUPT] = 1};
+
+static void alarm_fn(u32 pid);
+static i32 setup_frame(Pcb* pcb, HwContext* ctx, u32 signum);
+
+/* alarm_fn
+ * Description: Timer callback for a process' periodic ALARM
+ * Inputs: pid -- process the alarm belongs to
+ * Outputs: none
+ * Return Value: none
+ * Function: Raises ALARM and re-arms the timer for the next period
+ */
+static void alarm_fn(u32 const pid) {
+  send_signal(pid, SIG_ALARM);
+  add_timer(&get_pcb(pid)->alarm_timer, get_ticks() + ms_to_ticks(ALARM_PERIOD_MS));
+}
+
+/* setup_frame
+ * Description: Builds a signal frame on the user stack and redirects the return to the handler
+ * Inputs: pcb -- process receiving the signal
+ *         ctx -- registers the process will return to userspace with
+ *         signum -- signal being delivered
+ * Outputs: none
+ * Return Value: 0 on success, -1 if the user stack can't hold the frame
+ * Function: From the top of the user stack down: the sigreturn linkage, the saved hardware
+ *           context, the signal number and a return address pointing at the linkage. Signals are
+ *           masked until the handler calls sigreturn.
+ */
+static i32 setup_frame(Pcb* const pcb, HwContext* const ctx, u32 const signum) {
+  u32 const linkage = ctx->esp - SIGRETURN_LINKAGE_SIZE;
+  HwContext* const saved = (HwContext*)linkage - 1;
+  u32* const frame = (u32*)saved - 2;
+
+  if (bad_userspace_addr(frame, (i32)(ctx->esp - (u32)frame)))
+    return -1;
+
+  memcpy((void*)linkage, sigreturn_linkage, SIGRETURN_LINKAGE_SIZE);
+  memcpy(saved, ctx, sizeof(HwContext));
+  frame[0] = linkage;
+  frame[1] = signum;
+
+  ctx->esp = (u32)frame;
+  ctx->eip = (u32)pcb->sig_handler[signum];
+  pcb->sig_masked = SIG_ALL;
+
+  return 0;
+}
+
+/* init_signals
+ * Description: Resets a new process' signal state
+ * Inputs: pid -- process to reset
+ * Outputs: none
+ * Return Value: none
+ * Function: Every signal goes back to its default action, nothing is pending or masked
+ */
+void init_signals(u8 const pid) {
+  Pcb* const pcb = get_pcb(pid);
+
+  memset(pcb->sig_handler, 0, sizeof(pcb->sig_handler));
+  pcb->sig_pending = 0;
+  pcb->sig_masked = 0;
+  init_timer(&pcb->alarm_timer, alarm_fn, pid);
+}
+
+/* send_signal
+ * Description: Raises a signal for a process
+ * Inputs: pid -- process to signal
+ *         signum -- signal to raise
+ * Outputs: none
+ * Return Value: none
+ * Function: Marks the signal pending; it is acted on the next time the process returns to
+ *           userspace. A process blocked in the kernel is woken so that happens promptly.
+ */
+void send_signal(u32 const pid, Signal const signum) {
+  Pcb* pcb;
+
+  if (pid >= MAX_PID_COUNT || (u32)signum >= NUM_SIGNALS)
+    return;
+
+  pcb = get_pcb(pid);
+  pcb->sig_pending |= 1U << signum;
+
+  if (pcb->state == TASK_INTERRUPTIBLE)
+    wake_task(pid);
+}
+
+/* send_signal_foreground
+ * Description: Raises a signal for whatever a terminal is running in the foreground
+ * Inputs: term -- terminal whose foreground job to signal
+ *         signum -- signal to raise
+ * Outputs: none
+ * Return Value: none
+ * Function: The foreground job is the last process in the terminal's execute chain, or every
+ *           stage of the pipeline it spawned if it is waiting on one
+ */
+void send_signal_foreground(u8 const term, Signal const signum) {
+  Pcb* const leaf = get_terminal_task(term);
+  Pcb* pcb;
+  u32 pid, sent = 0;
+
+  for (pid = 0; pid < MAX_PID_COUNT; ++pid) {
+    if (!(pcb = get_task(pid)) || !pcb->spawned || pcb->parent_pcb != leaf ||
+        pcb->state == TASK_ZOMBIE)
+      continue;
+
+    send_signal(pid, signum);
+    sent = 1;
+  }
+
+  if (!sent)
+    send_signal(leaf->pid, signum);
+}
+
+/* signal_pending
+ * Description: Checks whether a process has an unmasked signal waiting
+ * Inputs: pid -- process to check
+ * Outputs: none
+ * Return Value: 1 if a signal is waiting, 0 otherwise
+ * Function: Lets blocking kernel code bail out early so the signal can be delivered
+ */
+i32 signal_pending(u32 const pid) {
+  Pcb const* pcb;
+
+  if (pid >= MAX_PID_COUNT)
+    return 0;
+
+  pcb = get_pcb(pid);
+  return !!(pcb->sig_pending & ~pcb->sig_masked);
+}
+
+/* deliver_signals
+ * Description: Acts on pending signals. Called by the interrupt linkage right before iret.
+ * Inputs: ctx -- registers about to be restored
+ * Outputs: none
+ * Return Value: none
+ * Function: Only runs when returning to userspace. Takes the lowest pending signal: ignored ones
+ *           are dropped, default-kill ones halt the process, and ones with a handler get a
+ *           signal frame so the iret lands in the handler.
+ */
+void deliver_signals(HwContext* const ctx) {
+  Pcb* pcb;
+  u32 pending, signum;
+
+  if (!(ctx->cs & DPL3))
+    return;
+
+  pcb = get_current_pcb();
+
+  while ((pending = pcb->sig_pending & ~pcb->sig_masked)) {
+    for (signum = 0; !(pending & (1U << signum)); ++signum)
+      ;
+
+    pcb->sig_pending &= ~(1U << signum);
+
+    if (pcb->sig_handler[signum]) {
+      /* A stack we can't write to leaves nowhere to run the handler */
+      if (!setup_frame(pcb, ctx, signum))
+        return;
+    } else if (!sig_default_kill[signum]) {
+      continue;
+    }
+
+    set_program_exception(1); /* So we can return > 8 bit value */
+    halt(1);
+  }
+}
+
+/* signal_set_handler
+ * Description: Changes the action for a signal
+ * Inputs: signum -- signal to change
+ *         handler_address -- user function to run, or NULL for the default action
+ * Outputs: none
+ * Return Value: 0 on success, -1 on failure
+ * Function: Installing an ALARM handler starts the process' periodic alarm timer; removing it
+ *           stops the timer, since the default action is to ignore ALARM anyway
+ */
+i32 signal_set_handler(u32 const signum, void* const handler_address) {
+  Pcb* const pcb = get_current_pcb();
+
+  if (signum >= NUM_SIGNALS)
+    return -1;
+
+  if (handler_address && bad_userspace_addr(handler_address, 1))
+    return -1;
+
+  pcb->sig_handler[signum] = handler_address;
+
+  if (signum == SIG_ALARM) {
+    if (handler_address && !timer_pending(&pcb->alarm_timer))
+      add_timer(&pcb->alarm_timer, get_ticks() + ms_to_ticks(ALARM_PERIOD_MS));
+    else if (!handler_address)
+      del_timer(&pcb->alarm_timer);
+  }
+
+  return 0;
+}
+
+/* signal_return
+ * Description: Restores the context saved by setup_frame
+ * Inputs: ctx -- registers of the sigreturn system call
+ * Outputs: none
+ * Return Value: the saved EAX, so the interrupted code sees its own value
+ * Function: Copies the hardware context off the user stack over ctx. Segments and privileged
+ *           EFLAGS bits are forced back to safe values so a handler can't escalate.
+ */
+i32 signal_return(HwContext* const ctx) {
+  Pcb* const pcb = get_current_pcb();
+  /* The handler's ret already popped the return address; skip the signal number */
+  HwContext const* const saved = (HwContext const*)(ctx->esp + ADDRESS_SIZE);
+  u32 const eflags = ctx->eflags;
+
+  if (bad_userspace_addr(saved, sizeof(HwContext)))
+    return -1;
+
+  memcpy(ctx, saved, sizeof(HwContext));
+
+  ctx->cs = USER_CS;
+  ctx->ss = USER_DS;
+  ctx->ds = USER_DS;
+  ctx->es = USER_DS;
+  ctx->fs = USER_DS;
+  ctx->eflags = (ctx->eflags & EFLAGS_USER_MASK) | (eflags & ~EFLAGS_USER_MASK);
+
+  pcb->sig_masked = 0;
+
+  return (i32)ctx->eax;
+}
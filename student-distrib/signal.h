@@ -0,0 +1,31 @@
+#ifndef SIGNAL_H
+#define SIGNAL_H
+
+#include "idt.h"
+#include "types.h"
+
+/* Numbering matches the userspace library (syscalls/ece391syscall.h) */
+typedef enum Signal {
+  SIG_DIV_ZERO = 0,
+  SIG_SEGFAULT,
+  SIG_INTERRUPT,
+  SIG_ALARM,
+  SIG_USER1,
+  NUM_SIGNALS
+} Signal;
+
+enum {
+  SIG_ALL = (1 << NUM_SIGNALS) - 1,
+  ALARM_PERIOD_MS = 10000,
+  SIGRETURN_LINKAGE_SIZE = 8 /* movl $SYSC_SIGRETURN, %eax; int $0x80; padded to a dword */
+};
+
+void init_signals(u8 pid);
+void send_signal(u32 pid, Signal signum);
+void send_signal_foreground(u8 term, Signal signum);
+i32 signal_pending(u32 pid);
+void deliver_signals(HwContext* ctx);
+i32 signal_set_handler(u32 signum, void* handler_address);
+i32 signal_return(HwContext* ctx);
+
+#endif
@@ -0,0 +1,467 @@
+#include "smp.h"
+#include "apic.h"
+#include "clock.h"
+#include "lib.h"
+#include "paging.h"
+#include "util.h"
+
+enum {
+  MP_ENTRY_PROC = 0,
+  MP_ENTRY_BUS,
+  MP_ENTRY_IOAPIC,
+  MP_ENTRY_IOINT,
+  MP_IOINT_INT = 0,        /* Vectored interrupt, as opposed to NMI/SMI/ExtINT */
+  MP_POLARITY_MASK = 0x3,  /* Interrupt entry flags; 0 in either field conforms to the bus */
+  MP_POLARITY_LOW = 0x3,
+  MP_TRIGGER_SHIFT = 2,
+  MP_TRIGGER_MASK = 0x3,
+  MP_TRIGGER_LEVEL = 0x3,
+  MP_ISA_BUS_NONE = 0xFF,
+  MP_PROC_ENTRY_SIZE = 20,
+  MP_OTHER_ENTRY_SIZE = 8, /* Every entry but a processor's */
+  MP_ENABLED = 1, /* Usable flag of processor and I/O APIC entries */
+  MP_SCAN_ALIGN = 16,
+  MP_BASE_MEM_TOP = 0x9FC00, /* Last KB of base memory */
+  MP_BASE_MEM_LEN = 0x400,
+  MP_BIOS_ROM = 0xF0000,
+  MP_BIOS_ROM_LEN = 0x10000,
+  MP_CONFIG_LIMIT = 0x400000 /* Only the first 4MB are identity mapped */
+};
+
+/* MP floating pointer structure */
+typedef struct MpFloat {
+  i8 sig[4]; /* "_MP_" */
+  u32 config;
+  u8 length;
+  u8 spec_rev;
+  u8 checksum;
+  u8 features[5];
+} PACKED MpFloat;
+
+/* MP configuration table header; the entries follow it */
+typedef struct MpConfig {
+  i8 sig[4]; /* "PCMP" */
+  u16 length;
+  u8 spec_rev;
+  u8 checksum;
+  i8 oem[8];
+  i8 product[12];
+  u32 oem_table;
+  u16 oem_size;
+  u16 entry_cnt;
+  u32 lapic_addr;
+  u16 ext_length;
+  u8 ext_checksum;
+  u8 reserved;
+} PACKED MpConfig;
+
+/* Processor entry of the configuration table */
+typedef struct MpProc {
+  u8 type;
+  u8 apic_id;
+  u8 apic_ver;
+  u8 flags;
+  u32 signature;
+  u32 features;
+  u32 reserved[2];
+} PACKED MpProc;
+
+/* Bus entry */
+typedef struct MpBus {
+  u8 type;
+  u8 bus_id;
+  i8 bus_type[6]; /* Space-padded, e.g. "ISA   " */
+} PACKED MpBus;
+
+/* I/O APIC entry */
+typedef struct MpIoApic {
+  u8 type;
+  u8 apic_id;
+  u8 apic_ver;
+  u8 flags;
+  u32 addr;
+} PACKED MpIoApic;
+
+/* I/O interrupt assignment entry: which I/O APIC pin a bus IRQ is wired to */
+typedef struct MpIoInt {
+  u8 type;
+  u8 int_type;
+  u16 flags;
+  u8 src_bus;
+  u8 src_irq;
+  u8 dst_apic;
+  u8 dst_pin;
+} PACKED MpIoInt;
+
+Cpu cpus[MAX_CPUS];
+
+static u32 num_cpus = 1;
+
+/* CPU the trampoline is starting; ap_main reads it */
+static u32 volatile ap_booting;
+
+static u8 ap_stacks[MAX_CPUS][AP_STACK_SIZE] ALIGNED(16);
+
+/* smp_asm.S; only the copy at AP_TRAMPOLINE_ADDR is ever run */
+extern u8 ap_trampoline[], ap_trampoline_end[];
+extern u8 ap_tramp_gdt[], ap_tramp_cr0[], ap_tramp_cr3[], ap_tramp_cr4[], ap_tramp_esp[];
+
+/* Address of a trampoline variable in the copy */
+#define TRAMP_VAR(sym) ((void*)(AP_TRAMPOLINE_ADDR + ((sym) - ap_trampoline)))
+
+static u8 checksum(void const* p, u32 len);
+static MpFloat* mp_scan(u32 addr, u32 len);
+static MpConfig* mp_find_config(void);
+static void mp_read_entries(MpConfig const* conf);
+static u32 mp_isa_redir(u16 flags);
+static void init_cpu_desc(Cpu* cpu);
+static i32 start_ap(Cpu* cpu);
+
+/* checksum
+ * Description: Adds up a range of bytes
+ * Inputs: p -- start of the range
+ *         len -- number of bytes
+ * Outputs: none
+ * Return Value: the sum, modulo 256
+ * Function: MP structures sum to zero
+ */
+static u8 checksum(void const* const p, u32 const len) {
+  u8 const* const b = (u8 const*)p;
+  u8 sum = 0;
+  u32 i;
+
+  for (i = 0; i < len; ++i)
+    sum += b[i];
+
+  return sum;
+}
+
+/* mp_scan
+ * Description: Looks for the MP floating pointer in a range of memory
+ * Inputs: addr -- start of the range, 16-byte aligned
+ *         len -- length of the range
+ * Outputs: none
+ * Return Value: the floating pointer, or NULL if it isn't there
+ * Function: Checks the signature and checksum at every 16-byte boundary
+ */
+static MpFloat* mp_scan(u32 const addr, u32 const len) {
+  u32 p;
+
+  for (p = addr; p + sizeof(MpFloat) <= addr + len; p += MP_SCAN_ALIGN) {
+    MpFloat* const mp = (MpFloat*)p;
+
+    if (!strncmp(mp->sig, "_MP_", sizeof(mp->sig)) && !checksum(mp, sizeof(MpFloat)))
+      return mp;
+  }
+
+  return NULL;
+}
+
+/* mp_find_config
+ * Description: Finds the MP configuration table
+ * Inputs: none
+ * Outputs: none
+ * Return Value: the table, or NULL if the BIOS didn't provide a usable one
+ * Function: Searches the last KB of base memory and the BIOS ROM. The EBDA pointer lives in page 0,
+ *           which we leave unmapped to catch NULL dereferences, so the EBDA itself isn't searched.
+ *           Default configurations (no table) are treated as a single CPU.
+ * Reference: MP Spec 1.4, 4.1
+ */
+static MpConfig* mp_find_config(void) {
+  MpFloat* mp;
+  MpConfig* conf;
+
+  if (!(mp = mp_scan(MP_BASE_MEM_TOP, MP_BASE_MEM_LEN)) &&
+      !(mp = mp_scan(MP_BIOS_ROM, MP_BIOS_ROM_LEN)))
+    return NULL;
+
+  if (!mp->config || mp->config >= MP_CONFIG_LIMIT)
+    return NULL;
+
+  conf = (MpConfig*)mp->config;
+  if (strncmp(conf->sig, "PCMP", sizeof(conf->sig)) || checksum(conf, conf->length))
+    return NULL;
+
+  return conf;
+}
+
+/* mp_read_entries
+ * Description: Fills in cpus[] and the I/O APIC routing from the configuration table
+ * Inputs: conf -- MP configuration table
+ * Outputs: none
+ * Return Value: none
+ * Function: The CPU we're running on is always cpus[0]; every other enabled processor is added
+ *           after it, up to MAX_CPUS. Only the first I/O APIC is used, and only ISA interrupts are
+ *           routed; the spec orders bus entries before the interrupt entries that refer to them.
+ * Reference: MP Spec 1.4, 4.3
+ */
+static void mp_read_entries(MpConfig const* const conf) {
+  u8 const* entry = (u8 const*)(conf + 1);
+  u32 const bsp_id = lapic_id();
+  u32 isa_bus = MP_ISA_BUS_NONE;
+  u32 ioapic_id = 0;
+  u8 have_ioapic = 0;
+  u32 i;
+
+  cpus[0].apic_id = bsp_id;
+
+  for (i = 0; i < conf->entry_cnt; ++i) {
+    switch (*entry) {
+    case MP_ENTRY_PROC: {
+      MpProc const* const proc = (MpProc const*)entry;
+
+      if ((proc->flags & MP_ENABLED) && proc->apic_id != bsp_id && num_cpus < MAX_CPUS)
+        cpus[num_cpus++].apic_id = proc->apic_id;
+
+      entry += MP_PROC_ENTRY_SIZE;
+      continue;
+    }
+
+    case MP_ENTRY_BUS: {
+      MpBus const* const bus = (MpBus const*)entry;
+
+      if (!strncmp(bus->bus_type, "ISA", 3))
+        isa_bus = bus->bus_id;
+      break;
+    }
+
+    case MP_ENTRY_IOAPIC: {
+      MpIoApic const* const io = (MpIoApic const*)entry;
+
+      if (!have_ioapic && (io->flags & MP_ENABLED)) {
+        set_ioapic_base(io->addr);
+        ioapic_id = io->apic_id;
+        have_ioapic = 1;
+      }
+      break;
+    }
+
+    case MP_ENTRY_IOINT: {
+      MpIoInt const* const ioint = (MpIoInt const*)entry;
+
+      if (have_ioapic && ioint->int_type == MP_IOINT_INT && ioint->src_bus == isa_bus &&
+          ioint->dst_apic == ioapic_id)
+        ioapic_route_isa(ioint->src_irq, ioint->dst_pin, mp_isa_redir(ioint->flags));
+      break;
+    }
+
+    default:
+      break;
+    }
+
+    entry += MP_OTHER_ENTRY_SIZE;
+  }
+}
+
+/* mp_isa_redir
+ * Description: Turns an ISA interrupt entry's flags into I/O APIC redirection bits
+ * Inputs: flags -- polarity and trigger mode fields of the entry
+ * Outputs: none
+ * Return Value: IOAPIC_ACTIVE_LOW and IOAPIC_LEVEL as the entry asks for them
+ * Function: A field that conforms to the bus means what ISA uses: active high, edge triggered.
+ *           Boards route some ISA IRQs (the ACPI SCI, for one) level triggered and active low.
+ * Reference: MP Spec 1.4, 4.3.4
+ */
+static u32 mp_isa_redir(u16 const flags) {
+  u32 redir = 0;
+
+  if ((flags & MP_POLARITY_MASK) == MP_POLARITY_LOW)
+    redir |= IOAPIC_ACTIVE_LOW;
+  if (((flags >> MP_TRIGGER_SHIFT) & MP_TRIGGER_MASK) == MP_TRIGGER_LEVEL)
+    redir |= IOAPIC_LEVEL;
+
+  return redir;
+}
+
+/* init_cpu_desc
+ * Description: Gives an application processor its own GDT and TSS
+ * Inputs: cpu -- CPU to set up
+ * Outputs: none
+ * Return Value: none
+ * Function: The GDT is a copy of the boot one whose TSS entry points at the CPU's own TSS, so
+ *           every CPU can have its TSS loaded (and marked busy) at once
+ */
+static void init_cpu_desc(Cpu* const cpu) {
+  seg_desc_t* const tss_desc = &cpu->gdt[KERNEL_TSS >> 3];
+
+  memcpy(cpu->gdt, gdt, sizeof(cpu->gdt));
+
+  memset(&cpu->tss, 0, sizeof(cpu->tss));
+  cpu->tss.ldt_segment_selector = KERNEL_LDT;
+  cpu->tss.ss0 = KERNEL_DS;
+  cpu->tss.esp0 = (u32)ap_stacks[cpu->id] + AP_STACK_SIZE;
+
+  tss_desc->granularity = 0x0;
+  tss_desc->opsize = 0x0;
+  tss_desc->reserved = 0x0;
+  tss_desc->avail = 0x0;
+  tss_desc->present = 0x1;
+  tss_desc->dpl = 0x0;
+  tss_desc->sys = 0x0;
+  tss_desc->type = 0x9;
+  SET_TSS_PARAMS((*tss_desc), &cpu->tss, TSS_SIZE - 1);
+
+  cpu->gdt_desc.size = sizeof(cpu->gdt) - 1;
+  cpu->gdt_desc.addr = (u32)cpu->gdt;
+}
+
+/* start_ap
+ * Description: Wakes up one application processor
+ * Inputs: cpu -- CPU to start
+ * Outputs: none
+ * Return Value: 0 once it's running ap_main, -1 if it never showed up
+ * Function: Fills in the trampoline's GDT, control registers and stack, then sends INIT followed
+ *           by up to two startup IPIs
+ * Reference: MP Spec 1.4, B.4
+ */
+static i32 start_ap(Cpu* const cpu) {
+  u32 cr0, cr3, cr4, waited;
+
+  init_cpu_desc(cpu);
+
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  asm volatile("mov %%cr3, %0" : "=r"(cr3));
+  asm volatile("mov %%cr4, %0" : "=r"(cr4));
+
+  /* lgdt takes the limit and base without our padding */
+  memcpy(TRAMP_VAR(ap_tramp_gdt), &cpu->gdt_desc.size, sizeof(u16) + sizeof(u32));
+  *(u32*)TRAMP_VAR(ap_tramp_cr0) = cr0;
+  *(u32*)TRAMP_VAR(ap_tramp_cr3) = cr3;
+  *(u32*)TRAMP_VAR(ap_tramp_cr4) = cr4;
+  *(u32*)TRAMP_VAR(ap_tramp_esp) = cpu->tss.esp0;
+  ap_booting = cpu->id;
+
+  lapic_send_init(cpu->apic_id);
+  clock_delay_us(AP_INIT_DELAY_US);
+
+  lapic_send_startup(cpu->apic_id, AP_TRAMPOLINE_ADDR);
+  clock_delay_us(AP_SIPI_DELAY_US);
+
+  if (!cpu->online)
+    lapic_send_startup(cpu->apic_id, AP_TRAMPOLINE_ADDR);
+
+  for (waited = 0; !cpu->online && waited < AP_START_TIMEOUT_US; waited += AP_SIPI_DELAY_US)
+    clock_delay_us(AP_SIPI_DELAY_US);
+
+  return cpu->online ? 0 : -1;
+}
+
+/* init_smp
+ * Description: Finds and starts the application processors
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Without an MP table or a local APIC we stay uniprocessor. Processors are started one
+ *           at a time since they share the trampoline. Must run after init_clock, and late enough
+ *           that nothing the boot loader left in low memory is still needed.
+ */
+void init_smp(void) {
+  MpConfig const* conf;
+  u32 i;
+
+  for (i = 0; i < MAX_CPUS; ++i)
+    cpus[i].id = i;
+
+  cpus[0].online = 1;
+
+  if (!(conf = mp_find_config()))
+    return;
+
+  set_lapic_base(conf->lapic_addr);
+  if (!lapic_present())
+    return;
+
+  init_lapic(1);
+  mp_read_entries(conf);
+
+  memcpy((void*)AP_TRAMPOLINE_ADDR, ap_trampoline, (u32)(ap_trampoline_end - ap_trampoline));
+
+  for (i = 1; i < num_cpus; ++i)
+    if (start_ap(&cpus[i]))
+      printf("SMP: CPU %u (APIC %u) didn't start\n", i, cpus[i].apic_id);
+}
+
+/* ap_main
+ * Description: Where an application processor lands after the trampoline
+ * Inputs: none
+ * Outputs: none
+ * Return Value: never returns
+ * Function: Loads the CPU's TSS and the shared IDT, enables its local APIC, matches the BSP's
+ *           PAT, starts its local APIC timer and reports in. Then it idles with interrupts on,
+ *           taking only its own timer, since the I/O APIC sends every device interrupt to the
+ *           bootstrap processor. It doesn't run tasks: running_pid, the TSS the scheduler loads
+ *           and the run queues are still single, and pipes, shared memory, paging and the timers
+ *           still guard their state with cli, which doesn't keep other CPUs out.
+ */
+void ap_main(void) {
+  Cpu* const cpu = &cpus[ap_booting];
+
+  ltr(KERNEL_TSS);
+  lidt(idt_desc_ptr);
+  init_lapic(0);
+  init_pat();
+  lapic_timer_ap();
+
+  cpu->online = 1;
+
+  for (;;)
+    asm volatile("sti; hlt");
+}
+
+/* irqh_ap_timer
+ * Description: Local APIC timer handler on the application processors
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Counts the tick on the CPU that took it. Touches nothing another CPU uses.
+ */
+void irqh_ap_timer(void) {
+  ++this_cpu()->ticks;
+  lapic_eoi();
+}
+
+/* get_num_cpus
+ * Description: Gets how many processors the MP table lists
+ * Inputs: none
+ * Outputs: none
+ * Return Value: number of entries of cpus[] in use
+ * Function: Getter
+ */
+u32 get_num_cpus(void) { return num_cpus; }
+
+/* get_cpus_online
+ * Description: Counts the processors that made it to the kernel
+ * Inputs: none
+ * Outputs: none
+ * Return Value: number of online CPUs, including the bootstrap processor
+ * Function: Checks each CPU's online flag
+ */
+u32 get_cpus_online(void) {
+  u32 i, cnt = 0;
+
+  for (i = 0; i < num_cpus; ++i)
+    cnt += !!cpus[i].online;
+
+  return cnt;
+}
+
+/* this_cpu
+ * Description: Gets the state of the CPU we're running on
+ * Inputs: none
+ * Outputs: none
+ * Return Value: its entry in cpus[]
+ * Function: Looks our APIC ID up; on a uniprocessor it's always cpus[0]
+ */
+Cpu* this_cpu(void) {
+  u32 id, i;
+
+  if (num_cpus == 1)
+    return &cpus[0];
+
+  id = lapic_id();
+  for (i = 1; i < num_cpus; ++i)
+    if (cpus[i].apic_id == id)
+      return &cpus[i];
+
+  return &cpus[0];
+}
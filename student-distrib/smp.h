@@ -0,0 +1,43 @@
+#ifndef SMP_H
+#define SMP_H
+
+/* Where the application processors start, in real mode; page-aligned and below 1MB */
+#define AP_TRAMPOLINE_ADDR 0x8000
+
+#ifndef ASM
+
+#include "types.h"
+#include "util.h"
+#include "x86_desc.h"
+
+enum {
+  MAX_CPUS = 8,
+  GDT_ENTRIES = 8,
+  AP_STACK_SIZE = 0x2000,
+  AP_INIT_DELAY_US = 10000, /* INIT to first SIPI, from the MP spec */
+  AP_SIPI_DELAY_US = 200,   /* Before trying the second SIPI */
+  AP_START_TIMEOUT_US = 100000
+};
+
+/* Per-CPU state. The bootstrap processor is cpus[0] and keeps using the boot GDT and TSS. */
+typedef struct Cpu {
+  u32 id;
+  u32 apic_id;
+  u32 volatile online;
+  u32 volatile ticks; /* Local APIC timer interrupts taken, on the application processors */
+  seg_desc_t gdt[GDT_ENTRIES] ALIGNED(8);
+  x86_desc_t gdt_desc;
+  tss_t tss;
+} Cpu;
+
+extern Cpu cpus[MAX_CPUS];
+
+void init_smp(void);
+u32 get_num_cpus(void);
+u32 get_cpus_online(void);
+Cpu* this_cpu(void);
+void ap_main(void);
+void irqh_ap_timer(void);
+
+#endif
+#endif
@@ -0,0 +1,158 @@
+#include "spinlock.h"
+#include "clock.h"
+
+#if LOCK_STATS
+/* Every lock passed to spin_init, for lock_stats_print */
+static Spinlock* locks[MAX_LOCKS];
+static u32 lock_cnt;
+#endif
+
+static void cpu_relax(void);
+
+/* cpu_relax
+ * Description: Spin-wait hint
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: pause keeps a spinning CPU from flooding the memory bus and lets a hyperthread
+ *           sibling (possibly the lock holder) run
+ */
+static void cpu_relax(void) { asm volatile("pause" ::: "memory"); }
+
+/* spin_init
+ * Description: Initializes a lock to unlocked
+ * Inputs: lock -- lock to initialize
+ *         name -- shown by lock_stats_print
+ * Outputs: none
+ * Return Value: none
+ * Function: With LOCK_STATS, also clears its counters and registers it for lock_stats_print
+ */
+void spin_init(Spinlock* const lock, i8* const name) {
+  lock->next = 0;
+  lock->owner = 0;
+
+#if LOCK_STATS
+  lock->name = name;
+  lock->acquired = 0;
+  lock->contended = 0;
+  lock->max_hold = 0;
+  lock->hold_cycles = 0;
+  lock->lock_tsc = 0;
+
+  if (lock_cnt < MAX_LOCKS)
+    locks[lock_cnt++] = lock;
+#else
+  (void)name;
+#endif
+}
+
+/* spin_lock
+ * Description: Acquires a lock, spinning until it is free
+ * Inputs: lock -- lock to acquire
+ * Outputs: none
+ * Return Value: none
+ * Function: Takes a ticket with an atomic xadd and waits for owner to reach it. Doesn't touch the
+ *           interrupt flag: use spin_lock_irqsave for anything an interrupt handler or preemption
+ *           could also reach. The lock isn't recursive.
+ */
+void spin_lock(Spinlock* const lock) {
+  u16 ticket = 1;
+
+  asm volatile("lock xaddw %0, %1" : "+r"(ticket), "+m"(lock->next) : : "memory", "cc");
+
+#if LOCK_STATS
+  if (lock->owner != ticket)
+    ++lock->contended;
+#endif
+
+  while (lock->owner != ticket)
+    cpu_relax();
+
+#if LOCK_STATS
+  ++lock->acquired;
+  lock->lock_tsc = rdtsc();
+#endif
+}
+
+/* spin_trylock
+ * Description: Acquires a lock only if nobody holds it or is waiting for it
+ * Inputs: lock -- lock to acquire
+ * Outputs: none
+ * Return Value: 1 if we got the lock, 0 otherwise
+ * Function: Takes a ticket with cmpxchg only if it would be served immediately
+ */
+i32 spin_trylock(Spinlock* const lock) {
+  u16 const owner = lock->owner;
+  u16 prev;
+
+  asm volatile("lock cmpxchgw %2, %1"
+               : "=a"(prev), "+m"(lock->next)
+               : "r"((u16)(owner + 1)), "0"(owner)
+               : "memory", "cc");
+
+  if (prev != owner)
+    return 0;
+
+#if LOCK_STATS
+  ++lock->acquired;
+  lock->lock_tsc = rdtsc();
+#endif
+
+  return 1;
+}
+
+/* spin_unlock
+ * Description: Releases a lock
+ * Inputs: lock -- lock held by the caller
+ * Outputs: none
+ * Return Value: none
+ * Function: Hands the lock to the next ticket. Only the holder writes owner, so a plain increment
+ *           after a compiler barrier is enough on x86.
+ */
+void spin_unlock(Spinlock* const lock) {
+#if LOCK_STATS
+  u32 const held = (u32)(rdtsc() - lock->lock_tsc);
+
+  lock->hold_cycles += held;
+  if (held > lock->max_hold)
+    lock->max_hold = held;
+#endif
+
+  asm volatile("" ::: "memory");
+  lock->owner = (u16)(lock->owner + 1);
+}
+
+/* spin_is_locked
+ * Description: Checks whether anyone holds a lock
+ * Inputs: lock -- lock to check
+ * Outputs: none
+ * Return Value: 1 if held, 0 if free
+ * Function: Only a snapshot; for assertions and tests
+ */
+i32 spin_is_locked(Spinlock const* const lock) { return lock->next != lock->owner; }
+
+/* lock_stats_print
+ * Description: Prints the contention counters of every registered lock
+ * Inputs: none
+ * Outputs: one line per lock
+ * Return Value: none
+ * Function: Shows acquisitions, how many of them had to spin, and the average and longest hold
+ *           time in cycles. Prints nothing unless the kernel was built with LOCK_STATS.
+ */
+void lock_stats_print(void) {
+#if LOCK_STATS
+  u32 i, avg;
+
+  for (i = 0; i < lock_cnt; ++i) {
+    Spinlock const* const lock = locks[i];
+
+    /* The quotient has to fit in 32 bits for divl */
+    avg = lock->acquired && (u32)(lock->hold_cycles >> 32) < lock->acquired
+              ? div64_32(lock->hold_cycles, lock->acquired, NULL)
+              : 0;
+
+    printf("%s: %u acquired, %u contended, hold avg %u max %u cycles\n", lock->name,
+           lock->acquired, lock->contended, avg, lock->max_hold);
+  }
+#endif
+}
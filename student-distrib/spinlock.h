@@ -0,0 +1,49 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "lib.h"
+#include "options.h"
+#include "types.h"
+
+enum {
+  MAX_LOCKS = 16 /* Locks lock_stats_print knows about */
+};
+
+/* Ticket lock: a CPU takes the next ticket and spins until owner reaches it, so waiters get the
+ * lock in the order they asked for it */
+typedef struct Spinlock {
+  u16 volatile next;
+  u16 volatile owner;
+#if LOCK_STATS
+  i8* name;
+  u32 acquired;
+  u32 contended;   /* Acquisitions that had to spin */
+  u32 max_hold;    /* Longest single hold, in TSC cycles */
+  u64 hold_cycles; /* Total time held, in TSC cycles */
+  u64 lock_tsc;    /* When the current holder got it */
+#endif
+} Spinlock;
+
+void spin_init(Spinlock* lock, i8* name);
+void spin_lock(Spinlock* lock);
+void spin_unlock(Spinlock* lock);
+i32 spin_trylock(Spinlock* lock);
+i32 spin_is_locked(Spinlock const* lock);
+void lock_stats_print(void);
+
+/* Same as spin_lock, but also saves EFLAGS into flags and disables interrupts first, so neither an
+ * interrupt handler nor preemption can run on this CPU while the lock is held */
+#define spin_lock_irqsave(lock, flags)                                                             \
+  do {                                                                                             \
+    cli_and_save(flags);                                                                           \
+    spin_lock(lock);                                                                               \
+  } while (0)
+
+/* Undoes spin_lock_irqsave; interrupts only come back on if they were on before it */
+#define spin_unlock_irqrestore(lock, flags)                                                        \
+  do {                                                                                             \
+    spin_unlock(lock);                                                                             \
+    restore_flags(flags);                                                                          \
+  } while (0)
+
+#endif
@@ -1,49 +1,68 @@
 #include "syscall.h"
+#include "fpu.h"
 #include "fs.h"
+#include "heap.h"
 #include "lib.h"
+#include "pipe.h"
+#include "pit.h"
 #include "rtc.h"
+#include "shm.h"
 #include "terminal_driver.h"
 #include "util.h"
+#include "vm.h"
 #include "x86_desc.h"
 
 typedef i32 (*Syscall)(u32 arg1, u32 arg2, u32 arg3);
 
-FileOps const std_in_fops = {terminal_open, terminal_close, terminal_read, write_failure};
-FileOps const std_out_fops = {terminal_open, terminal_close, read_failure, terminal_write};
-FileOps const rtc_fops = {rtc_open, rtc_close, rtc_read, rtc_write};
-FileOps const fs_fops = {file_open, file_close, file_read, file_write};
-FileOps const dir_fops = {dir_open, dir_close, dir_read, dir_write};
+FileOps const std_in_fops = {terminal_open, terminal_close, terminal_read, write_failure,
+                             terminal_poll};
+FileOps const std_out_fops = {terminal_open, terminal_close, read_failure, terminal_write,
+                              poll_writable};
+FileOps const rtc_fops = {rtc_open, rtc_close, rtc_read, rtc_write, rtc_poll};
+FileOps const fs_fops = {file_open, file_close, file_read, file_write, file_poll};
+FileOps const dir_fops = {dir_open, dir_close, dir_read, dir_write, dir_poll};
+FileOps const pipe_read_fops = {pipe_open, pipe_read_close, pipe_read, write_failure,
+                                pipe_read_poll};
+FileOps const pipe_write_fops = {pipe_open, pipe_write_close, read_failure, pipe_write,
+                                 pipe_write_poll};
 
 u8 const elf_header[] = {0x7F, 'E', 'L', 'F'};
 Syscall const syscalls[] = {
     (Syscall)halt,  (Syscall)execute, (Syscall)read,   (Syscall)write,       (Syscall)open,
-    (Syscall)close, (Syscall)getargs, (Syscall)vidmap, (Syscall)set_handler, (Syscall)sigreturn};
+    (Syscall)close, (Syscall)getargs, (Syscall)vidmap, (Syscall)set_handler, (Syscall)sigreturn,
+    (Syscall)sleep, (Syscall)yield,   (Syscall)poll,
+    (Syscall)fcntl, (Syscall)shm_create, (Syscall)shm_attach, (Syscall)pipe, (Syscall)spawn,
+    (Syscall)wait, (Syscall)nice, (Syscall)gettime, (Syscall)getprocs,
+    (Syscall)sbrk};
 
 u8 procs = 0x0;
 u8 running_pid = 0;
 
 static u8 program_exception_occured = 0;
 
+static i32 alloc_pid(void);
+static void free_pid(u32 pid);
+static void release_fd(Pcb* pcb, i32 fd);
+static void dup_fd(FileDesc* dst, FileDesc const* src);
+static i32 load_program(u8 const* ucmd, i8* cmd, u32* entry);
+static void init_task(Pcb* pcb, u32 pid, i8 const* cmd);
+static void task_start(void);
+
 /* irqh_syscall
  * Description: IRQ Handler for system calls
- * Inputs: type -- Type of syscall
- *         arg1 -- Argument 1
- *         arg2 -- Argument 2
- *         arg3 -- Argument 3
+ * Inputs: ctx -- Registers saved by the linkage; EAX holds the type, EBX/ECX/EDX the arguments
  * Outputs: none
  * Return Value: -1 if fails
  * Function: Uses a jump table to call function given type and passed arguments
  */
-i32 irqh_syscall(void) {
-  SyscallType type;
+i32 irqh_syscall(HwContext* const ctx) {
+  SyscallType const type = (SyscallType)ctx->eax;
+  Pcb* const pcb = get_current_pcb();
   Syscall func;
-  u32 arg1, arg2, arg3;
-
-  /* Read the syscall type and arguments */
-  asm volatile("" : "=a"(type), "=b"(arg1), "=c"(arg2), "=d"(arg3));
+  i32 ret;
 
   /* Ensure the type is within bounds */
-  if (!(u32)type || (u32)type > (u32)SYSC_SIGRETURN)
+  if (!(u32)type || (u32)type > (u32)SYSC_SBRK)
     return -1;
 
   /* Get the function from the jump table, do NULL check */
@@ -52,12 +71,18 @@ i32 irqh_syscall(void) {
   if (!func)
     return -1;
 
-  /* Call it */
-  return func(arg1, arg2, arg3);
+  /* Everything up to here was user time */
+  acct_charge(pcb, 1);
+  ++pcb->nr_syscalls;
 
-  /* EAX, ECX, EDX: Handled in ASM linkage
-   * EBX, EDI, ESI: Handled by the compiler
-   */
+  /* sigreturn needs to rewrite the frame we return through */
+  pcb->syscall_ctx = ctx;
+
+  /* Call it; execute only comes back here once the child halts */
+  ret = func(ctx->ebx, ctx->ecx, ctx->edx);
+
+  acct_charge(pcb, 0);
+  return ret;
 }
 
 /* get_pcb
@@ -78,6 +103,95 @@ Pcb* get_pcb(u8 proc) { return (Pcb*)(MB8 - (proc + 1) * KB8); }
  */
 Pcb* get_current_pcb(void) { return get_pcb(running_pid); }
 
+/* get_task
+ * Description: Gets a process' PCB if the pid is in use
+ * Inputs: pid -- process id
+ * Outputs: none
+ * Return Value: the PCB, or NULL if no process (or zombie) has that pid
+ * Function: Checks the pid bitmap
+ */
+Pcb* get_task(u32 const pid) {
+  if (pid >= MAX_PID_COUNT || !(procs & (FIRST_PID >> pid)))
+    return NULL;
+
+  return get_pcb((u8)pid);
+}
+
+/* alloc_pid
+ * Description: Reserves the lowest free pid
+ * Inputs: none
+ * Outputs: none
+ * Return Value: the pid, or -1 if every pid is in use
+ * Function: Sets the pid's bit in the bitmap
+ */
+static i32 alloc_pid(void) {
+  u32 i;
+  u8 mask;
+
+  for (i = 0, mask = FIRST_PID; i < MAX_PID_COUNT; ++i, mask >>= 1)
+    if (!(mask & procs)) {
+      procs |= mask;
+      return (i32)i;
+    }
+
+  return -1;
+}
+
+/* free_pid
+ * Description: Releases a pid
+ * Inputs: pid -- pid to release
+ * Outputs: none
+ * Return Value: none
+ * Function: Clears the pid's bit in the bitmap
+ */
+static void free_pid(u32 const pid) { procs &= ~(FIRST_PID >> pid); }
+
+/* release_fd
+ * Description: Closes one of a process' descriptors without any checks
+ * Inputs: pcb -- process owning the descriptor
+ *         fd -- descriptor to close
+ * Outputs: none
+ * Return Value: none
+ * Function: Lets the driver drop its reference (pipes count their ends) and clears the descriptor
+ */
+static void release_fd(Pcb* const pcb, i32 const fd) {
+  FileDesc* const desc = &pcb->fds[fd];
+
+  if ((desc->flags & FD_IN_USE) && desc->jumptable && desc->jumptable->close)
+    desc->jumptable->close(fd);
+
+  desc->flags = 0;
+  desc->file_position = 0;
+  desc->inode = 0;
+  desc->jumptable = NULL;
+}
+
+/* dup_fd
+ * Description: Copies a descriptor into another process
+ * Inputs: dst -- descriptor to fill in
+ *         src -- descriptor to copy
+ * Outputs: none
+ * Return Value: none
+ * Function: Pipe ends are reference counted, so copying one takes another reference
+ */
+static void dup_fd(FileDesc* const dst, FileDesc const* const src) {
+  *dst = *src;
+
+  if (src->flags & FD_PIPE)
+    pipe_get(src->inode, src->jumptable == &pipe_write_fops);
+}
+
+/* fd_nonblocking
+ * Description: Checks whether reads on a descriptor of the current process may block
+ * Inputs: fd -- file descriptor
+ * Outputs: none
+ * Return Value: 1 if the descriptor is in non-blocking mode, 0 otherwise
+ * Function: Used by drivers whose reads would otherwise wait for data
+ */
+i32 fd_nonblocking(i32 const fd) {
+  return fd >= 0 && fd < FD_CNT && (get_current_pcb()->fds[fd].flags & FD_NONBLOCK);
+}
+
 /* set_program_exception
  * Description: setter for the halt function, this function set's a static boolean to indicate if a
  * exception was thrown and the proc was killed by the shell Inputs: u8 bval: boolean to enable or
@@ -98,23 +212,62 @@ i32 halt(u8 const status) {
 
   Pcb* const pcb = get_current_pcb();
 
-  if (pcb && pcb->parent_pcb)
+  if (pcb && pcb->parent_pcb && !pcb->spawned)
     pcb->parent_pcb->child_pcb = NULL;
 
+  /* Make sure a pending sleep or alarm can't fire on a reused pid */
+  del_timer(&pcb->sleep_timer);
+  del_timer(&pcb->alarm_timer);
+
+  /* Let go of shared memory before the pid can be reused */
+  shm_exit(pcb->pid);
+  fpu_release(pcb);
+
   /* If we're the "parent process" of the OS (pid == 0, shell) don't halt it */
-  /* Close all FDs for the current process */
+  /* Close all FDs for the current process, including stdin/stdout since they may be pipes */
   for (i = 0; i < FD_CNT; ++i)
-    close(i);
+    release_fd(pcb, (i32)i);
+
+  /* Spawned children we never waited for clean up after themselves */
+  for (i = 0; i < MAX_PID_COUNT; ++i) {
+    Pcb* const child = get_task(i);
+
+    if (!child || !child->spawned || child->parent_pcb != pcb)
+      continue;
+
+    child->parent_pcb = NULL;
+    if (child->state == TASK_ZOMBIE)
+      free_pid(i);
+  }
+
+  // if a program exception occured, we ignore the halt status and return 256 to eax
+  pcb->child_return = program_exception_occured ? PROCESS_KILLED_BY_EXCEPTION : status;
+  set_program_exception(0);
+
+  if (pcb->spawned) {
+    /* Nobody returns into a spawned task; stay a zombie until wait() collects the status */
+    remove_task_pgdir(pcb->pid);
+    pcb->state = TASK_ZOMBIE;
+
+    if (pcb->parent_pcb)
+      wake_up(&pcb->parent_pcb->child_wait);
+    else
+      free_pid(pcb->pid);
+
+    /* Never comes back */
+    block_current();
+  }
 
   terminal* term = get_running_terminal();
 
   /* Marks pid as completed */
-  procs &= ~(FIRST_PID >> pcb->pid);
+  free_pid(pcb->pid);
 
   if (pcb->parent_pid == -1) {
     // if the process is a terminal, we mark it as not running, so it's id can be taken in execute
     tss.esp0 = MB8 - KB8 * (term->pid + 1) - ADDRESS_SIZE;
-    terminals[current_terminal].running = 0;
+    term->running = 0;
+    remove_task_pgdir(pcb->pid);
 
     // Load KSP/KPB from last execute call
     // this works bro, just trust me
@@ -127,12 +280,13 @@ i32 halt(u8 const status) {
     execute((u8*)"shell");
   }
 
-  // if a program exception occured, we ignore the halt status and return 256 to eax
-  pcb->child_return = program_exception_occured ? PROCESS_KILLED_BY_EXCEPTION : status;
-  set_program_exception(0);
+  /* The parent stops waiting in execute */
+  pcb->parent_pcb->state = TASK_RUNNING;
 
   tss.esp0 = MB8 - KB8 * (pcb->parent_pid + 1) - ADDRESS_SIZE;
   running_pid = pcb->parent_pid;
+  fpu_switch_to(pcb->parent_pcb);
+  acct_resume(pcb->parent_pcb);
 
   /* There is a parent, we need to switch contexts to the parent */
   remove_task_pgdir(pcb->pid);
@@ -155,29 +309,25 @@ i32 halt(u8 const status) {
   return -1;
 }
 
-/* execute
- * Description: Executes system calls
- * Inputs: ucmd -- system call to execute
+/* load_program
+ * Description: Loads an executable into a new process' address space
+ * Inputs: ucmd -- command line; the first word names the executable
+ *         cmd -- buffer of ARGS_SIZE to fill with the executable name and its arguments
+ *         entry -- where to store the program's entry point
  * Outputs: none
- * Return Value: if fails return -1, if success return 0
- * Function: Checks cmd validity, if valid executes a system call given as ucmd input
+ * Return Value: the new pid, or -1 on failure
+ * Function: Checks the file is an ELF executable, allocates a pid and maps the program image
+ *           from the image cache. Leaves the new process' page directory loaded.
  */
-i32 execute(u8 const* const ucmd) {
-  cli();
-
-  i8 cmd[ARGS_SIZE];
-  Pcb* const parent = get_current_pcb();
+static i32 load_program(u8 const* const ucmd, i8* const cmd, u32* const entry) {
   DirEntry dentry;
-  u32 entry;
   u8 header[ELF_HEADER_SIZE];
-  u8 mask;
   u32 i, j, l;
+  i32 pid;
 
   /* If our input is null, fail */
-  if (!ucmd) {
-    sti();
+  if (!ucmd)
     return -1;
-  }
 
   /* Copy the input argument neglecting leading spaces */
   memset(cmd, 0, ARGS_SIZE);
@@ -198,54 +348,125 @@ i32 execute(u8 const* const ucmd) {
   cmd[j] = '\0';
 
   /* If directory entry read fails, fail */
-  if (read_dentry_by_name((u8*)cmd, &dentry)) {
-    sti();
+  if (read_dentry_by_name((u8*)cmd, &dentry))
     return -1;
-  }
 
   /* If the data read isn't the size of the data, fail */
-  if (read_data(dentry.inode_idx, 0, header, sizeof(header)) != sizeof(header)) {
-    sti();
+  if (read_data(dentry.inode_idx, 0, header, sizeof(header)) != sizeof(header))
     return -1;
-  }
 
   /* If file is an invalid executable, fail */
   for (i = 0; i < sizeof(header); ++i)
-    if (header[i] != elf_header[i]) {
-      sti();
+    if (header[i] != elf_header[i])
       return -1;
-    }
 
-  for (i = 0, mask = FIRST_PID; i < MAX_PID_COUNT; ++i, mask >>= 1)
-    if (!(mask & procs)) {
-      procs |= mask;
-      running_pid = i;
-      /* Go away, this code's great */
-      goto cont;
-    }
+  /* If bytes read from file isn't the same as the size of the file, fail */
+  if (file_read_name(cmd, (u8*)entry, ENTRY_POINT_OFFSET, sizeof(*entry)) != sizeof(*entry))
+    return -1;
 
-  sti();
-  return -1;
+  if ((pid = alloc_pid()) == -1)
+    return -1;
 
-cont:
-  /* If bytes read from file isn't the same as the size of the file, fail */
-  if (file_read_name(cmd, (u8*)&entry, ENTRY_POINT_OFFSET, sizeof(entry)) != sizeof(entry)) {
-    sti();
+  /* make_task_pgdir only switches page directories once it has succeeded */
+  if (make_task_pgdir((u8)pid)) {
+    free_pid((u32)pid);
     return -1;
   }
 
-  /* If making page directory fails, fail */
-  if (make_task_pgdir(running_pid)) {
-    sti();
+  /* If mapping the program into it fails, give the directory back and go back to our own */
+  if (map_image((u8)pid, dentry.inode_idx)) {
+    remove_task_pgdir((u8)pid);
+    free_pid((u32)pid);
+    flush_tlb();
     return -1;
   }
 
-  /* If file read was unsuccessful after making pgdir, fail */
-  if (file_read_name(cmd, (u8*)LOAD_ADDR, 0, 0) == -1) {
-    sti();
+  return pid;
+}
+
+/* init_task
+ * Description: Fills in the parts of a new PCB common to execute and spawn
+ * Inputs: pcb -- new process' PCB
+ *         pid -- new process' pid
+ *         cmd -- executable name and arguments from load_program
+ * Outputs: none
+ * Return Value: none
+ * Function: Sets up stdin/stdout on the terminal, argv, and the scheduling and signal state
+ */
+static void init_task(Pcb* const pcb, u32 const pid, i8 const* const cmd) {
+  u32 i;
+
+  /* Sets first two file descriptors to stdin and stdout, and that they're in use */
+  for (i = 0; i < FD_START; ++i) {
+    pcb->fds[i].jumptable = (i == 0) ? &std_in_fops : &std_out_fops;
+    pcb->fds[i].flags = FD_IN_USE;
+    pcb->fds[i].inode = 0;
+    pcb->fds[i].file_position = 0;
+  }
+
+  /* Sets the rest of the file descriptors to NULL and not in use */
+  for (i = FD_START; i < FD_CNT; ++i) {
+    pcb->fds[i].jumptable = NULL;
+    pcb->fds[i].flags = FD_NOT_IN_USE;
+    pcb->fds[i].inode = 0;
+    pcb->fds[i].file_position = 0;
+  }
+
+  /* Setup argv to point to sections of the raw_argv string to seperate args */
+  memcpy(pcb->raw_argv, cmd, ARGS_SIZE);
+  pcb->argv[0] = pcb->raw_argv;
+  // set the remaining section of the argument
+  pcb->argv[1] = pcb->raw_argv + strlen(pcb->raw_argv) + 1;
+
+  pcb->pid = pid;
+  pcb->child_pcb = NULL;
+  pcb->spawned = 0;
+  pcb->prio = 0;
+  pcb->nice = 0;
+
+  /* New processes start out runnable, with their sleep timer disarmed */
+  pcb->state = TASK_RUNNING;
+  pcb->fpu_used = 0;
+  pcb->brk = HEAP_START;
+  acct_init(pcb);
+  init_timer(&pcb->sleep_timer, wake_task, pcb->pid);
+  init_signals(pcb->pid);
+  init_wait_queue(&pcb->child_wait);
+}
+
+/* task_start
+ * Description: First code a spawned process runs in the kernel
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: spawn builds the new kernel stack so the scheduler's first switch to the task returns
+ *           here; from here we drop straight into the program
+ */
+static void task_start(void) { uspace((i32)get_current_pcb()->entry); }
+
+/* execute
+ * Description: Executes system calls
+ * Inputs: ucmd -- system call to execute
+ * Outputs: none
+ * Return Value: if fails return -1, if success return 0
+ * Function: Checks cmd validity, if valid executes a system call given as ucmd input
+ */
+i32 execute(u8 const* const ucmd) {
+  i8 cmd[ARGS_SIZE];
+  Pcb* const parent = get_current_pcb();
+  u32 entry, flags;
+  i32 pid;
+
+  /* The scheduler calls us with interrupts already off, so a failure must leave them that way */
+  cli_and_save(flags);
+
+  if ((pid = load_program(ucmd, cmd, &entry)) == -1) {
+    restore_flags(flags);
     return -1;
   }
 
+  running_pid = (u8)pid;
+
   {
     Pcb* const pcb = get_current_pcb();
 
@@ -256,42 +477,22 @@ cont:
                  "mov %%ebp, %1;"
                  : "=g"(esp), "=g"(ebp));
 
-    /* Sets first two file descriptors to stdin and stdout, and that they're in use */
-    for (i = 0; i < FD_START; ++i) {
-      pcb->fds[i].jumptable = (i == 0) ? &std_in_fops : &std_out_fops;
-      pcb->fds[i].flags = FD_IN_USE;
-      pcb->fds[i].inode = 0;
-      pcb->fds[i].file_position = 0;
-    }
-
-    /* Sets the rest of the file descriptors to NULL and not in use */
-    for (i = FD_START; i < FD_CNT; ++i) {
-      pcb->fds[i].jumptable = NULL;
-      pcb->fds[i].flags = FD_NOT_IN_USE;
-      pcb->fds[i].inode = 0;
-      pcb->fds[i].file_position = 0;
-    }
-
-    /* Setup argv to point to sections of the raw_argv string to seperate args */
-    memcpy(pcb->raw_argv, cmd, ARGS_SIZE);
-    pcb->argv[0] = pcb->raw_argv;
-    // set the remaining section of the argument
-    pcb->argv[1] = pcb->raw_argv + strlen(pcb->raw_argv) + 1;
+    init_task(pcb, running_pid, cmd);
 
     /* Set the pcb pid and it's parents ksp and kbp */
-    pcb->pid = running_pid;
     pcb->parent_ksp = esp;
     pcb->parent_kbp = ebp;
 
-    /* Create a new terminal if needed */
+    /* Create a new terminal if needed; the scheduler starts shells on the terminal it is running */
     terminal* term;
-    if (terminals[current_terminal].running == 1) {
-      term = &terminals[current_terminal];
+    if (terminals[get_current_schedule()].running == 1) {
+      term = &terminals[get_current_schedule()];
     } else {
       term = new_terminal(running_pid);
     }
+    pcb->term = term->id;
+
     /* Set child pcb to null and set parent pid based on the terminals pid */
-    pcb->child_pcb = NULL;
     pcb->parent_pid =
         (running_pid == term->pid) ? -1 : (i32)parent->pid; /* Special case 1st proc */
 
@@ -299,16 +500,18 @@ cont:
     pcb->parent_pcb = parent;
     if (pcb->parent_pid != -1) {
       parent->child_pcb = pcb;
+      pcb->nice = pcb->prio = parent->nice;
+      /* The parent can't run again until we halt */
+      parent->state = TASK_UNINTERRUPTIBLE;
     } else {
       pcb->parent_pcb = NULL;
     }
 
     /* New KSP */
     tss.esp0 = MB8 - KB8 * (running_pid + 1) - ADDRESS_SIZE;
+    fpu_switch_to(pcb);
 
-    sti();
-
-    /* Enter into userspace */
+    /* Enter into userspace; the iret turns interrupts back on */
     uspace(entry);
 
     /* After return from userspace return the appropriate value */
@@ -316,6 +519,133 @@ cont:
   }
 }
 
+/* spawn
+ * Description: Starts a program that runs alongside the caller
+ * Inputs: ucmd -- command line to run
+ *         fd_in -- caller's descriptor to use as the program's stdin
+ *         fd_out -- caller's descriptor to use as the program's stdout
+ * Outputs: none
+ * Return Value: the new process' pid, or -1 on failure
+ * Function: Unlike execute the caller keeps running; it collects the exit status with wait.
+ *           The new process is scheduled like any other and starts in task_start.
+ */
+i32 spawn(u8 const* const ucmd, i32 const fd_in, i32 const fd_out) {
+  Pcb* const parent = get_current_pcb();
+  i8 cmd[ARGS_SIZE];
+  Pcb* pcb;
+  u32* stack;
+  u32 entry, flags;
+  i32 pid;
+
+  if (fd_in < 0 || fd_in >= FD_CNT || !(parent->fds[fd_in].flags & FD_IN_USE) || fd_out < 0 ||
+      fd_out >= FD_CNT || !(parent->fds[fd_out].flags & FD_IN_USE))
+    return -1;
+
+  cli_and_save(flags);
+
+  if ((pid = load_program(ucmd, cmd, &entry)) == -1) {
+    restore_flags(flags);
+    return -1;
+  }
+
+  /* load_program left the child's page directory loaded */
+  flush_tlb();
+
+  pcb = get_pcb((u8)pid);
+  init_task(pcb, (u32)pid, cmd);
+
+  dup_fd(&pcb->fds[0], &parent->fds[fd_in]);
+  dup_fd(&pcb->fds[1], &parent->fds[fd_out]);
+
+  pcb->spawned = 1;
+  pcb->nice = pcb->prio = parent->nice;
+  pcb->entry = entry;
+  pcb->term = parent->term;
+  pcb->parent_pcb = parent;
+  pcb->parent_pid = (i32)parent->pid;
+
+  /* Fake the frame switch_to unwinds: zeroed callee-saved registers, then task_start */
+  stack = (u32*)(MB8 - KB8 * (pid + 1) - ADDRESS_SIZE) - (SWITCH_FRAME_WORDS + 1);
+  memset(stack, 0, SWITCH_FRAME_WORDS * sizeof(u32));
+  stack[SWITCH_FRAME_WORDS] = (u32)task_start;
+  pcb->ksp = (u32)stack;
+  enqueue_task((u32)pid);
+
+  restore_flags(flags);
+  return pid;
+}
+
+/* wait
+ * Description: Waits for a spawned child to halt
+ * Inputs: pid -- child to wait for
+ * Outputs: none
+ * Return Value: the child's exit status (256 if an exception killed it), -1 on failure or if a
+ *               signal interrupted the wait
+ * Function: Sleeps on the caller's child_wait queue until the child is a zombie, then frees its pid
+ */
+i32 wait(i32 const pid) {
+  Pcb* const pcb = get_current_pcb();
+  Pcb* child;
+  u32 flags;
+  i32 ret;
+
+  if (pid < 0 || !(child = get_task((u32)pid)) || !child->spawned || child->parent_pcb != pcb)
+    return -1;
+
+  cli_and_save(flags);
+
+  while (child->state != TASK_ZOMBIE) {
+    if (signal_pending(pcb->pid)) {
+      restore_flags(flags);
+      return -1;
+    }
+
+    wait_on(&pcb->child_wait);
+  }
+
+  ret = (i32)child->child_return;
+  free_pid((u32)pid);
+
+  restore_flags(flags);
+  return ret;
+}
+
+/* pipe
+ * Description: Creates a pipe
+ * Inputs: fds -- where to store the read end (fds[0]) and write end (fds[1])
+ * Outputs: none
+ * Return Value: if fails return -1, if success return 0
+ * Function: Allocates two descriptors backed by a one-page ring buffer
+ */
+i32 pipe(i32* const fds) {
+  Pcb* const pcb = get_current_pcb();
+  i32 ends[2];
+  u32 handle, i, n;
+
+  if (!fds || bad_userspace_addr(fds, sizeof(ends)))
+    return -1;
+
+  for (i = FD_START, n = 0; i < FD_CNT && n < 2; ++i)
+    if (!(pcb->fds[i].flags & FD_IN_USE))
+      ends[n++] = (i32)i;
+
+  if (n < 2 || pipe_create(&handle))
+    return -1;
+
+  for (i = 0; i < 2; ++i) {
+    FileDesc* const desc = &pcb->fds[ends[i]];
+
+    desc->jumptable = i ? &pipe_write_fops : &pipe_read_fops;
+    desc->inode = handle;
+    desc->file_position = 0;
+    desc->flags = FD_IN_USE | FD_PIPE;
+  }
+
+  fds[0] = ends[0];
+  fds[1] = ends[1];
+  return 0;
+}
+
 /* read
  * Description: Reads n bytes into buffer
  * Inputs: fd -- file descriptor
@@ -333,8 +663,6 @@ i32 read(i32 const fd, void* const buf, i32 const nbytes) {
       ((pcb->fds[fd].flags & FD_IN_USE) == FD_NOT_IN_USE) || !pcb->fds[fd].jumptable)
     return -1;
 
-  sti();
-
   return pcb->fds[fd].jumptable->read(fd, buf, nbytes);
 }
 
@@ -442,10 +770,7 @@ i32 close(i32 fd) {
     return -1;
 
   /* Close file */
-  pcb->fds[fd].flags = 0;
-  pcb->fds[fd].file_position = 0;
-  pcb->fds[fd].inode = 0;
-  pcb->fds[fd].jumptable = NULL;
+  release_fd(pcb, fd);
   return 0;
 }
 
@@ -515,16 +840,171 @@ i32 vidmap(u8** screen_start) {
  * Return Value: if fails return -1, if success return 0
  * Function: Changes the default action for a signal for a particular signal
  */
-i32 set_handler(u32 UNUSED(signum), void* UNUSED(handler_address)) { NIMPL; }
+i32 set_handler(u32 const signum, void* const handler_address) {
+  return signal_set_handler(signum, handler_address);
+}
 
 /* sigreturn
  * Description: Copies hardware context on the user-level stack to the processor
  * Inputs: none
  * Outputs: none
- * Return Value: if fails return -1, if success return 0
+ * Return Value: if fails return -1, if success the EAX of the interrupted context
  * Function: Copies hardware context on the user-level stack to the processor
  */
-i32 sigreturn(void) { NIMPL; }
+i32 sigreturn(void) { return signal_return(get_current_pcb()->syscall_ctx); }
+
+/* sleep
+ * Description: Blocks the calling process for a number of milliseconds
+ * Inputs: ms -- number of milliseconds to sleep for
+ * Outputs: none
+ * Return Value: 0 once the deadline has passed or a signal arrived
+ * Function: Arms the process' sleep timer on the timer wheel and gives up the CPU. The scheduler
+ *           skips the process until the timer fires and wakes it.
+ */
+i32 sleep(u32 const ms) {
+  Pcb* const pcb = get_current_pcb();
+
+  if (!ms)
+    return yield();
+
+  /* +1 because the current tick is already partially over */
+  pcb->state = TASK_INTERRUPTIBLE;
+  add_timer(&pcb->sleep_timer, get_ticks() + ms_to_ticks(ms) + 1);
+
+  block_current();
+
+  /* A signal may have woken us before the deadline */
+  del_timer(&pcb->sleep_timer);
+
+  return 0;
+}
+
+/* yield
+ * Description: Gives up the rest of the calling process' time slice
+ * Inputs: none
+ * Outputs: none
+ * Return Value: 0
+ * Function: Lets the scheduler run another terminal's task; returns immediately if there is none
+ */
+i32 yield(void) {
+  schedule();
+  return 0;
+}
+
+/* nice
+ * Description: Lowers (or raises back) the current process' scheduling priority
+ * Inputs: inc -- amount to add to the niceness, 0 just reads it
+ * Outputs: none
+ * Return Value: the new niceness, from 0 to NUM_PRIO_LEVELS - 1
+ * Function: Hands off to the scheduler
+ */
+i32 nice(i32 const inc) { return sched_nice(inc); }
+
+/* gettime
+ * Description: Reads the monotonic clock
+ * Inputs: ts -- where to store the seconds and nanoseconds since boot
+ * Outputs: none
+ * Return Value: if fails return -1, if success return 0
+ * Function: The clock is the TSC, calibrated at boot, so it has far finer resolution than the PIT
+ */
+i32 gettime(Timespec* const ts) {
+  if (!ts || bad_userspace_addr(ts, sizeof(*ts)))
+    return -1;
+
+  clock_timespec(ts);
+  return 0;
+}
+
+/* poll
+ * Description: Waits until at least one of a set of file descriptors is ready
+ * Inputs: fds -- descriptors to check, with the events wanted for each; revents is filled in
+ *         nfds -- number of entries in fds
+ *         timeout_ms -- how long to wait; 0 returns immediately, negative waits forever
+ * Outputs: none
+ * Return Value: number of descriptors with events, 0 on timeout, -1 on failure or a signal
+ * Function: Asks each descriptor's poll callback for its readiness. If nothing is ready the
+ *           process sleeps on every descriptor's wait queue at once (and its sleep timer, for a
+ *           timeout) and checks again when any of them wakes it.
+ */
+i32 poll(PollFd* const fds, u32 const nfds, i32 const timeout_ms) {
+  Pcb* const pcb = get_current_pcb();
+  u32 const deadline = get_ticks() + ms_to_ticks((u32)timeout_ms) + 1;
+  PollTable pt;
+  u32 flags, i;
+  i32 ready;
+
+  if (!fds || !nfds || nfds > FD_CNT || bad_userspace_addr(fds, (i32)(nfds * sizeof(PollFd))))
+    return -1;
+
+  pt.cnt = 0;
+
+  /* Interrupts stay off between checking and sleeping so no wake up gets lost */
+  cli_and_save(flags);
+
+  if (timeout_ms > 0)
+    add_timer(&pcb->sleep_timer, deadline);
+
+  for (;;) {
+    ready = 0;
+
+    for (i = 0; i < nfds; ++i) {
+      i32 const fd = fds[i].fd;
+
+      if (fd < 0 || fd >= FD_CNT || !(pcb->fds[fd].flags & FD_IN_USE) || !pcb->fds[fd].jumptable)
+        fds[i].revents = POLL_NVAL;
+      else
+        fds[i].revents = (u16)(pcb->fds[fd].jumptable->poll(fd, &pt) & fds[i].events);
+
+      if (fds[i].revents)
+        ++ready;
+    }
+
+    if (ready || !timeout_ms || signal_pending(pcb->pid) ||
+        (timeout_ms > 0 && (i32)(get_ticks() - deadline) >= 0))
+      break;
+
+    pcb->state = TASK_INTERRUPTIBLE;
+    block_current();
+    poll_table_release(&pt);
+  }
+
+  poll_table_release(&pt);
+  del_timer(&pcb->sleep_timer);
+  restore_flags(flags);
+
+  return (ready || !signal_pending(pcb->pid)) ? ready : -1;
+}
+
+/* fcntl
+ * Description: Gets or changes a file descriptor's flags
+ * Inputs: fd -- file descriptor
+ *         cmd -- F_GETFL to read the flags, F_SETFL to replace them
+ *         arg -- new flags for F_SETFL; only FD_NONBLOCK may be changed
+ * Outputs: none
+ * Return Value: if fails return -1, the flags for F_GETFL, 0 for F_SETFL
+ * Function: Lets a process switch a descriptor between blocking and non-blocking reads
+ */
+i32 fcntl(i32 const fd, u32 const cmd, u32 const arg) {
+  Pcb* const pcb = get_current_pcb();
+
+  if (fd < 0 || fd >= FD_CNT || !(pcb->fds[fd].flags & FD_IN_USE))
+    return -1;
+
+  switch ((FcntlCmd)cmd) {
+  case F_GETFL:
+    return (i32)(pcb->fds[fd].flags & ~FD_IN_USE);
+
+  case F_SETFL:
+    if (arg & ~FD_NONBLOCK)
+      return -1;
+
+    pcb->fds[fd].flags = (pcb->fds[fd].flags & ~FD_NONBLOCK) | arg;
+    return 0;
+
+  default:
+    return -1;
+  }
+}
 
 /* set_pid
  * Description: This has been left as an exercise for the TA.
@@ -552,3 +1032,12 @@ i32 read_failure(i32 UNUSED(fd), void* UNUSED(buf), i32 UNUSED(nbytes)) { return
  * Function: lol
  */
 i32 write_failure(i32 UNUSED(fd), void const* UNUSED(buf), i32 UNUSED(nbytes)) { return -1; }
+
+/* poll_writable
+ * Description: Poll callback for descriptors whose writes never block
+ * Inputs: fd, pt (UNUSED)
+ * Outputs: none
+ * Return Value: POLL_OUT
+ * Function: Reports the descriptor as always writable
+ */
+i32 poll_writable(i32 UNUSED(fd), PollTable* UNUSED(pt)) { return POLL_OUT; }
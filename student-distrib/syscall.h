@@ -1,7 +1,14 @@
 #ifndef SYSCALL_H
 #define SYSCALL_H
 
+#include "acct.h"
+#include "clock.h"
+#include "fpu.h"
+#include "idt.h"
+#include "signal.h"
+#include "timer.h"
 #include "types.h"
+#include "wait.h"
 
 enum {
   ENTRY_POINT_OFFSET = 24,
@@ -16,6 +23,8 @@ enum {
 enum {
   FD_NOT_IN_USE = 0,
   FD_IN_USE = 1,
+  FD_NONBLOCK = 1 << 1, /* Reads return immediately instead of waiting for data */
+  FD_PIPE = 1 << 2,     /* Either end of a pipe; inode holds the pipe's index */
   FIRST_PID = 0x80,
   FD_START = 2,
   ADDRESS_SIZE = 4,
@@ -23,7 +32,6 @@ enum {
   MAX_PID_COUNT = 8,
   FD_CNT = 8,
   ARGS_SIZE = 128,
-  NUM_SIGNALS = 4,
   PROCESS_KILLED_BY_EXCEPTION = 256
 };
 
@@ -37,14 +45,40 @@ typedef enum SyscallType {
   SYSC_GETARGS,
   SYSC_VIDMAP,
   SYSC_SET_HANDLER,
-  SYSC_SIGRETURN
+  SYSC_SIGRETURN,
+  SYSC_SLEEP,
+  SYSC_YIELD,
+  SYSC_POLL,
+  SYSC_FCNTL,
+  SYSC_SHM_CREATE,
+  SYSC_SHM_ATTACH,
+  SYSC_PIPE,
+  SYSC_SPAWN,
+  SYSC_WAIT,
+  SYSC_NICE,
+  SYSC_GETTIME,
+  SYSC_GETPROCS,
+  SYSC_SBRK
 } SyscallType;
 
+/* Commands for fcntl */
+typedef enum FcntlCmd { F_GETFL = 1, F_SETFL } FcntlCmd;
+
+/* Readiness bits for poll */
+typedef enum PollEvent { POLL_IN = 1, POLL_OUT = 1 << 2, POLL_NVAL = 1 << 5 } PollEvent;
+
+typedef struct PollFd {
+  i32 fd;
+  u16 events;
+  u16 revents;
+} PollFd;
+
 typedef struct FileOps {
   i32 (*open)(u8 const* filename);
   i32 (*close)(i32 fd);
   i32 (*read)(i32 fd, void* buf, i32 nbytes);
   i32 (*write)(i32 fd, void const* buf, i32 nbytes);
+  i32 (*poll)(i32 fd, PollTable* pt); /* Returns the PollEvents that won't block right now */
 } FileOps;
 
 typedef struct FileDesc {
@@ -61,13 +95,34 @@ typedef struct Pcb {
   u32 pid;
   u32 parent_ksp;
   u32 parent_kbp;
-  u32 ksp;
-  u32 kbp;
+  u32 ksp; /* Saved by switch_to while the process is switched out */
   i32 parent_pid;
   struct Pcb* parent_pcb;
   struct Pcb* child_pcb;
   u32 child_return;
-  void* sig_handler[4];
+  void* sig_handler[NUM_SIGNALS];
+  u32 sig_pending;
+  u32 sig_masked;
+  HwContext* syscall_ctx; /* Registers of the system call in progress, for sigreturn */
+  Timer alarm_timer;
+  u8 state;
+  u8 on_rq; /* Queued on the scheduler's run queue */
+  u8 rq_prio; /* Level of the queue it is on, while on_rq is set */
+  u8 prio;  /* Current priority level, 0 is the highest */
+  u8 nice;  /* Highest priority level the process may run at */
+  Timer sleep_timer;
+  u8 term;          /* Terminal the process belongs to */
+  u8 spawned;       /* Started by spawn: runs alongside its parent, which collects it with wait */
+  u32 entry;        /* Program entry point, for spawned processes' first switch */
+  WaitQueue child_wait; /* Woken when a spawned child halts */
+  u64 utime;            /* TSC cycles spent in user mode (see acct.c) */
+  u64 stime;            /* TSC cycles spent in the kernel */
+  u64 acct_tsc;         /* When utime or stime was last charged */
+  u32 nr_switches;      /* Times the process was switched away from */
+  u32 nr_syscalls;
+  u32 brk;              /* End of the heap (see heap.c) */
+  u8 fpu_used;          /* fpu_state holds this process' registers (see fpu.c) */
+  u8 fpu_state[FPU_STATE_SIZE] ALIGNED(FPU_STATE_ALIGN);
 } Pcb;
 
 /* Implemented in syscall_asm.S */
@@ -83,12 +138,24 @@ i32 getargs(u8* buf, i32 nbytes);
 i32 vidmap(u8** screen_start);
 i32 set_handler(u32 signum, void* handler_address);
 i32 sigreturn(void);
-i32 irqh_syscall(void);
+i32 sleep(u32 ms);
+i32 yield(void);
+i32 poll(PollFd* fds, u32 nfds, i32 timeout_ms);
+i32 fcntl(i32 fd, u32 cmd, u32 arg);
+i32 pipe(i32* fds);
+i32 spawn(u8 const* command, i32 fd_in, i32 fd_out);
+i32 wait(i32 pid);
+i32 nice(i32 inc);
+i32 gettime(Timespec* ts);
+i32 irqh_syscall(HwContext* ctx);
 void set_pid(u8 pid);
 Pcb* get_current_pcb(void);
 Pcb* get_pcb(u8 proc);
+Pcb* get_task(u32 pid);
+i32 fd_nonblocking(i32 fd);
 i32 read_failure(i32 fd, void* buf, i32 nbytes);
 i32 write_failure(i32 fd, void const* buf, i32 nbytes);
+i32 poll_writable(i32 fd, PollTable* pt);
 
 void set_program_exception(u8 val);
 #endif
@@ -1,19 +1,43 @@
 #include "terminal_driver.h"
+#include "frame.h"
 #include "keyboard.h"
 #include "lib.h"
 #include "pit.h"
+#include "spinlock.h"
 #include "syscall.h"
+#include "util.h"
 #include "x86_desc.h"
 
+/* Serializes output to the terminals with terminal switches, which copy video memory around, and
+ * guards the line bufs and read flags the keyboard IRQ shares with readers */
+Spinlock term_lock;
+
 /* terminal_read
  * Description: Read input from the terminal
- * Inputs: buf - buf to write line buf to
+ * Inputs: fd - descriptor being read, checked for non-blocking mode
+ *         buf - buf to write line buf to
  *         nbytes - number of bytes to read
  * Outputs: none
- * Return Value: number of bytes read
+ * Return Value: number of bytes read, 0 if non-blocking and no full line is buffered yet
  * Function: To read from the line buf
  */
-i32 terminal_read(i32 UNUSED(fd), void* const buf, i32 const nbytes) {
+i32 terminal_read(i32 const fd, void* const buf, i32 const nbytes) {
+  terminal* const term = get_running_terminal();
+  u32 flags;
+
+  /* Keep accepting keystrokes, but don't wait for the line to be finished */
+  if (term && fd_nonblocking(fd)) {
+    spin_lock_irqsave(&term_lock, flags);
+
+    if (contains_newline(term->line_buf, LINE_BUFFER_SIZE) == -1) {
+      term->read_flag = 1;
+      spin_unlock_irqrestore(&term_lock, flags);
+      return 0;
+    }
+
+    spin_unlock_irqrestore(&term_lock, flags);
+  }
+
   /* Get line buf and return size of bytes read */
   return get_line_buf((char*)buf, nbytes);
 }
@@ -27,18 +51,17 @@ i32 terminal_read(i32 UNUSED(fd), void* const buf, i32 const nbytes) {
  * Function: To write to the line buf
  */
 i32 terminal_write(i32 UNUSED(fd), void const* const buf, i32 const nbytes) {
-  cli();
-
   /* Typecast buf to a char* */
   terminal* term = get_running_terminal();
   char const* const cbuf = (char const*)buf;
   i32 i, bytes_written = 0;
+  u32 flags;
 
   /* If params are invalid return -1 */
-  if (nbytes <= 0 || !buf || !term) {
-    sti();
+  if (nbytes <= 0 || !buf || !term)
     return -1;
-  }
+
+  spin_lock_irqsave(&term_lock, flags);
 
   for (i = 0; i < nbytes; ++i) {
     /* Write to screen */
@@ -46,7 +69,7 @@ i32 terminal_write(i32 UNUSED(fd), void const* const buf, i32 const nbytes) {
     ++bytes_written;
   }
 
-  sti();
+  spin_unlock_irqrestore(&term_lock, flags);
 
   /* Return bytes written */
   return bytes_written;
@@ -70,6 +93,32 @@ i32 terminal_open(const u8* UNUSED(filename)) { return 0; }
  */
 i32 terminal_close(i32 UNUSED(fd)) { return 0; }
 
+/* terminal_poll
+ * Description: Reports whether a terminal read would block
+ * Inputs: pt - poll table to register the terminal's read queue on
+ * Outputs: none
+ * Return Value: POLL_IN if a full line is buffered, 0 otherwise
+ * Function: Leaves read_flag to terminal_read. While the poll is registered on the read queue the
+ *           keyboard accepts keystrokes into the line buf, so a poll can wait for a line without
+ *           leaving the terminal taking input once it returns.
+ */
+i32 terminal_poll(i32 UNUSED(fd), PollTable* const pt) {
+  terminal* const term = get_running_terminal();
+  u32 flags;
+  i32 ready;
+
+  if (!term)
+    return 0;
+
+  poll_wait(&term->read_wait, pt);
+
+  spin_lock_irqsave(&term_lock, flags);
+  ready = contains_newline(term->line_buf, LINE_BUFFER_SIZE) != -1;
+  spin_unlock_irqrestore(&term_lock, flags);
+
+  return ready ? POLL_IN : 0;
+}
+
 /* get_terminal_from_pid
  * Description: Get pointer to a terminal from a pid
  * Inputs: u32 pid -- pid to find terminal from
@@ -93,26 +142,17 @@ terminal* get_terminal_from_pid(u32 pid) {
  * Inputs: none
  * Outputs: none
  * Return Value: terminal* -- pointer to the running terminal
- * Function: Finds a terminal from the current pcb and iterates through it's parents
+ * Function: Every process records the terminal it was started on (execute/spawn copy it from
+ *           the parent)
  */
 terminal* get_running_terminal(void) {
-  Pcb* pcb = get_current_pcb();
-  terminal* term;
-  /* If the current pcb is the terminal return it */
-  if ((term = get_terminal_from_pid(pcb->pid)))
-    return term;
-  /* If it is not the current termial and there is no parent there is no terminal */
-  if (!(pcb->parent_pcb))
-    return NULL;
-  /* Iterate through the parents of the pcb and see if any of them are the terminal */
-  while (pcb->parent_pcb != NULL || pcb->parent_pcb->pid != pcb->pid) {
-    if ((term = get_terminal_from_pid(pcb->parent_pid)))
-      return term;
-    /* Go to parent pcb */
-    pcb = pcb->parent_pcb;
-  }
+  Pcb const* const pcb = get_current_pcb();
+
   /* If no terminal is running on the current pcb return null */
-  return NULL;
+  if (pcb->term >= TERMINAL_NUM)
+    return NULL;
+
+  return &terminals[pcb->term];
 }
 
 /* init_terminals
@@ -126,6 +166,10 @@ terminal* get_running_terminal(void) {
 void init_terminals(void) {
   int i;
   terminal* term;
+  u32 buf;
+
+  spin_init(&term_lock, "terminal");
+
   /* For each terminal set everything to 0 */
   for (i = 0; i < TERMINAL_NUM; i++) {
     term = &terminals[i];
@@ -141,8 +185,14 @@ void init_terminals(void) {
     term->rtc.virt_freq = RTC_DEFAULT_VIRT_FREQ;
     term->rtc.int_count = 0;
     term->rtc.flag = 0;
-    /* Set the video mem buffer to be next to the physical video memory */
-    term->vid_mem_buf = (u8*)(VIDEO + (KB4 * (i + 1)));
+    init_wait_queue(&term->rtc.wait);
+    init_wait_queue(&term->read_wait);
+    /* A frame of its own; the direct map lets the kernel write it at its physical address */
+    if (!(buf = frame_alloc())) {
+      printf("Failed to allocate terminal video memory!\n");
+      HLTLOOP;
+    }
+    term->vid_mem_buf = (u8*)buf;
     term->id = (u8)i;
     term->vidmap = 0;
     /* Set line buffer to 0 */
@@ -181,19 +231,21 @@ void init_terminals(void) {
  * as well as the terminal status for the pit
  */
 void switch_terminal(u8 term_num) {
+  u32 flags;
+
   /* Ensure valid input and that it is not the current terminal */
   if (current_terminal == term_num || term_num >= TERMINAL_NUM)
     return;
 
   /* Critical section on code. Must not be interrupted */
-  cli();
+  spin_lock_irqsave(&term_lock, flags);
 
   /* Restore new terminals properties and change the current terminal */
   restore_terminal(term_num);
   current_terminal = term_num;
   terminals[term_num].status = TASK_RUNNING;
 
-  sti();
+  spin_unlock_irqrestore(&term_lock, flags);
 }
 
 /* restore_terminal
@@ -240,10 +292,20 @@ void restore_terminal(u8 term_num) {
  * Inputs: u8 pid -- pid to set to terminal
  * Outputs: none
  * Return Value: terminal* -- running terminal created by new_terminal
- * Function: Finds and returns the first availible terminal
+ * Function: Claims the terminal the scheduler is starting a shell on, falling back to the first
+ *           availible terminal
  */
 terminal* new_terminal(u8 pid) {
   int i;
+  u8 const sched = get_current_schedule();
+
+  /* Prefer the terminal being scheduled so a shell lands where it was asked for */
+  if (!terminals[sched].running) {
+    terminals[sched].pid = pid;
+    terminals[sched].running = 1;
+    return &terminals[sched];
+  }
+
   /* Iterate through all terminals */
   for (i = 0; i < TERMINAL_NUM; i++) {
     if (terminals[i].running)
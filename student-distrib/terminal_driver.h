@@ -3,6 +3,8 @@
 
 #include "keyboard.h"
 #include "lib.h"
+#include "spinlock.h"
+#include "wait.h"
 #define TERMINAL_NUM 3
 
 #define RTC_DEFAULT_REAL_FREQ 1024
@@ -16,6 +18,7 @@ typedef struct virtual_rtc {
   u32 real_freq; // The intial, real freq requested of RTC (1024)
   u32 int_count;
   volatile u8 flag;
+  WaitQueue wait; // Readers and pollers waiting for the next virtual interrupt
 } virtual_rtc;
 
 typedef struct {
@@ -25,6 +28,7 @@ typedef struct {
 	u32 pid;
 	u8 id;
 	u8 read_flag;
+	WaitQueue read_wait;
 	u8* vid_mem_buf;
 	u8 running;
 	u8 status;
@@ -34,12 +38,14 @@ typedef struct {
 
 u8 current_terminal;
 terminal terminals[TERMINAL_NUM];
+extern Spinlock term_lock;
 
 /* Define Function Calls */
 i32 terminal_read(i32 fd, void* buf, i32 nbytes);
 i32 terminal_write(i32 fd, void const* buf, i32 nbytes);
 i32 terminal_open(const u8* filename);
 i32 terminal_close(i32 fd);
+i32 terminal_poll(i32 fd, PollTable* pt);
 
 void restore_terminal(u8 term_num);
 void switch_terminal(u8 term_num);
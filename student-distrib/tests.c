@@ -1,14 +1,31 @@
 #include "tests.h"
+#include "acct.h"
+#include "apic.h"
+#include "clock.h"
+#include "fpu.h"
+#include "frame.h"
 #include "fs.h"
+#include "heap.h"
+#include "i8259.h"
 #include "idt.h"
 #include "keyboard.h"
+#include "kmalloc.h"
 #include "lib.h"
 #include "options.h"
 #include "paging.h"
+#include "pipe.h"
+#include "pit.h"
 #include "rtc.h"
+#include "shm.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "signal.h"
 #include "syscall.h"
 #include "terminal_driver.h"
+#include "timer.h"
 #include "util.h"
+#include "vm.h"
+#include "wait.h"
 #include "x86_desc.h"
 
 enum { FAIL, PASS };
@@ -128,11 +145,11 @@ TEST(PAGING) {
   /* Check 4KB page directory entry for valid address + permission bits (because the CPU can set
    * other bits) */
 
-  if ((pgdir[0][0] & PDE_USED_4K) != (PG_PRESENT | PG_RW | (u32)pgtbl))
+  if ((pgdir[0] & PDE_USED_4K) != (PG_PRESENT | PG_RW | (u32)pgtbl))
     TEST_FAIL;
 
   /* Check kernel entry for valid address + permission bits */
-  if ((pgdir[0][1] & PDE_USED_4M) != (PG_PRESENT | PG_RW | PG_SIZE | PG_4M_START))
+  if ((pgdir[1] & PDE_USED_4M) != (PG_PRESENT | PG_RW | PG_SIZE | PG_4M_START))
     TEST_FAIL;
 
   /* Check nullptr region */
@@ -150,10 +167,28 @@ TEST(PAGING) {
     else if ((pgtbl[i] & PDE_USED_4K) != ((i * PTE_SIZE) | PG_RW | PG_PRESENT))
       TEST_FAIL_MSG("i: %u", i);
 
-  /* Check that the 4MB to 4GB range has the correct bits set (4MB entries, not present), no
-   * address yet */
-  for (i = 2; i < PGDIR_LEN; ++i)
-    if ((pgdir[0][i] & PDE_USED_4M & ~1U) != ((i * PG_4M_START) | PG_RW | PG_USPACE | PG_SIZE))
+  /* The direct map is present and kernel-only */
+  for (i = DIRECT_MAP_START_PG; i < DIRECT_MAP_END_PG; ++i)
+    if ((pgdir[i] & PDE_USED_4M) != ((i * PG_4M_START) | PG_PRESENT | PG_RW | PG_SIZE))
+      TEST_FAIL_MSG("i: %u", i);
+
+  /* Check that the rest of the range up to 4GB has the correct bits set (4MB entries, not
+   * present), no address yet */
+  for (i = DIRECT_MAP_END_PG; i < PGDIR_LEN; ++i)
+    if (i != APIC_PG &&
+        (pgdir[i] & PDE_USED_4M & ~1U) != ((i * PG_4M_START) | PG_RW | PG_USPACE | PG_SIZE))
+      TEST_FAIL_MSG("i: %u", i);
+
+  /* The kernel survives CR3 loads. The low 4MB must not, since processes map it user-accessible
+   * and remap the video page. */
+  u32 cr4;
+  asm volatile("mov %%cr4, %0" : "=r"(cr4));
+
+  if (!(cr4 & CR4_PGE) || !(pgdir[1] & PG_GLOBAL))
+    TEST_FAIL;
+
+  for (i = 0; i < PGTBL_LEN; ++i)
+    if (pgtbl[i] & PG_GLOBAL)
       TEST_FAIL_MSG("i: %u", i);
 
   /* Memory sanity check */
@@ -503,6 +538,944 @@ TEST(EXEC_TESTPRINT) {
 
 /***** }}} CHECKPOINT 3 *****/
 
+/***** SCHEDULING {{{ *****/
+
+static u32 timer_test_fired;
+
+static void timer_test_fn(u32 data);
+static void timer_test_fn(u32 const data) { timer_test_fired = data; }
+
+/* Timer Wheel Test
+ *
+ * Drives the wheel by hand and checks timers fire on the right tick
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Advances the tick count
+ * Coverage: Root wheel expiry, cascading from the outer wheels, next_timer_tick, del_timer
+ */
+TEST(TIMER) {
+  Timer timer;
+  u32 i;
+
+  init_timer(&timer, timer_test_fn, 391);
+
+  /* Far enough out that it has to cascade down from an outer wheel */
+  timer_test_fired = 0;
+  add_timer(&timer, get_ticks() + TVR_SIZE * 3 + 7);
+
+  for (i = 0; i < TVR_SIZE * 3 + 6; ++i)
+    run_timers();
+
+  if (timer_test_fired || !timer_pending(&timer))
+    TEST_FAIL;
+
+  run_timers();
+
+  if (timer_test_fired != 391 || timer_pending(&timer))
+    TEST_FAIL;
+
+  /* Tickless idle must never sleep past a pending timer */
+  add_timer(&timer, get_ticks() + 5);
+
+  if ((i32)(next_timer_tick(get_ticks() + NOHZ_MAX_TICKS) - timer.expires) > 0)
+    TEST_FAIL;
+
+  /* A deleted timer must never fire */
+  timer_test_fired = 0;
+  add_timer(&timer, get_ticks() + 2);
+  del_timer(&timer);
+
+  for (i = 0; i < 4; ++i)
+    run_timers();
+
+  if (timer_test_fired || timer_pending(&timer))
+    TEST_FAIL;
+
+  TEST_END;
+}
+
+/* Tickless Test
+ *
+ * Idles in one-shot mode for a tick and a half at a time and counts the ticks that went by
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Advances the tick count, runs with interrupts off for about 6ms
+ * Coverage: tick_nohz_start, tick_nohz_stop carrying the partial tick between idle periods
+ */
+TEST(NOHZ) {
+  u32 const start = get_ticks();
+  u32 flags, i, ticks;
+
+  cli_and_save(flags);
+
+  for (i = 0; i < 4; ++i) {
+    tick_nohz_start();
+    clock_delay_us(US_IN_SEC / PIT_HZ * 3 / 2);
+    tick_nohz_stop();
+  }
+
+  ticks = get_ticks() - start;
+  restore_flags(flags);
+
+  /* Six ticks, less part of the one the first start cut short; dropping the halves gives four */
+  if (ticks < 5 || ticks > 7)
+    TEST_FAIL;
+
+  TEST_END;
+}
+
+/* Clock Test
+ *
+ * Checks the TSC calibration and the nanosecond clock
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: init_clock calibration, cycles_to_ns, clock_ns monotonicity, clock_timespec
+ */
+TEST(CLOCK) {
+  u32 const khz = get_tsc_khz();
+  u64 const ns = cycles_to_ns((u64)khz * MS_IN_SEC);
+  u64 prev, now;
+  Timespec ts;
+  u32 i;
+
+  if (!khz)
+    TEST_FAIL;
+
+  /* A second's worth of cycles is a second, give or take the multiplier's rounding */
+  if (ns > (u64)NS_IN_SEC || ns < (u64)NS_IN_SEC - NS_IN_MS)
+    TEST_FAIL;
+
+  for (i = 0, prev = clock_ns(); i < 1000; ++i, prev = now)
+    if ((now = clock_ns()) < prev)
+      TEST_FAIL;
+
+  clock_timespec(&ts);
+  if (ts.nsec >= NS_IN_SEC)
+    TEST_FAIL;
+
+  TEST_END;
+}
+
+/* CPU Accounting Test
+ *
+ * Charges the current process for a busy loop and a fake context switch
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Adds to the current process' counters
+ * Coverage: acct_charge, acct_switch, cycles_to_us
+ */
+TEST(ACCT) {
+  Pcb* const pcb = get_current_pcb();
+  u64 const khz = get_tsc_khz();
+  u64 const utime = pcb->utime, stime = pcb->stime;
+  u32 const switches = pcb->nr_switches;
+  u32 const us = cycles_to_us(khz * MS_IN_SEC);
+
+  /* A second's worth of cycles, give or take the multiplier's rounding */
+  if (us > US_IN_SEC || us < US_IN_SEC - US_IN_SEC / MS_IN_SEC)
+    TEST_FAIL;
+
+  acct_charge(pcb, 0);
+  clock_delay_us(100);
+  acct_charge(pcb, 1);
+
+  if (pcb->stime < stime || pcb->utime - utime < khz / 10 || pcb->acct_tsc > rdtsc())
+    TEST_FAIL;
+
+  acct_switch(pcb, NULL);
+  if (pcb->nr_switches != switches + 1)
+    TEST_FAIL;
+
+  TEST_END;
+}
+
+/* FPU Test
+ *
+ * Pretends to switch between the current process and an unused pid and checks the x87 control
+ * word follows each of them
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Scribbles over the last pid's PCB
+ * Coverage: fpu_switch_to setting TS, exc_nm save/restore and first-use initialization
+ */
+TEST(FPU) {
+  Pcb* const cur = get_current_pcb();
+  Pcb* const other = get_pcb(MAX_PID_COUNT - 1);
+  u16 const cw_custom = 0x027F; /* 53-bit precision instead of the default 64 */
+  u16 cw;
+  u32 cr0;
+
+  fpu_release(cur);
+  fpu_release(other);
+  cur->fpu_used = 0;
+  other->fpu_used = 0;
+
+  /* First use traps and starts from a clean FPU */
+  fpu_switch_to(cur);
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  if (!(cr0 & CR0_TS))
+    TEST_FAIL;
+
+  asm volatile("fldcw %0" : : "m"(cw_custom));
+  if (get_fpu_owner() != cur || !cur->fpu_used)
+    TEST_FAIL;
+
+  /* The other process gets its own default state; ours is saved on the way */
+  set_pid((u8)other->pid);
+  fpu_switch_to(other);
+  asm volatile("fnstcw %0" : "=m"(cw));
+  set_pid((u8)cur->pid);
+
+  if (get_fpu_owner() != other || cw != FPU_DEFAULT_CW)
+    TEST_FAIL;
+
+  /* Switching back brings our control word back */
+  fpu_switch_to(cur);
+  asm volatile("fnstcw %0" : "=m"(cw));
+
+  if (get_fpu_owner() != cur || cw != cw_custom)
+    TEST_FAIL;
+
+  /* Running the owner again doesn't trap */
+  fpu_switch_to(cur);
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  if (cr0 & CR0_TS)
+    TEST_FAIL;
+
+  fpu_release(cur);
+
+  TEST_END;
+}
+
+/* Signal Test
+ *
+ * Raises signals on an unused pid and checks the pending and mask bookkeeping
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Scribbles over the last pid's PCB
+ * Coverage: send_signal, signal_pending, masking, bad_userspace_addr on kernel memory
+ */
+TEST(SIGNALS) {
+  u32 const pid = MAX_PID_COUNT - 1;
+  Pcb* const pcb = get_pcb(pid);
+  u32 kernel_word = 0;
+
+  pcb->state = TASK_RUNNING;
+  init_signals(pid);
+
+  if (signal_pending(pid))
+    TEST_FAIL;
+
+  send_signal(pid, SIG_USER1);
+
+  if (!signal_pending(pid) || pcb->sig_pending != 1U << SIG_USER1)
+    TEST_FAIL;
+
+  /* Masked signals stay pending but aren't reported */
+  pcb->sig_masked = SIG_ALL;
+  if (signal_pending(pid))
+    TEST_FAIL;
+
+  pcb->sig_masked = 0;
+  init_signals(pid);
+
+  /* Out of range signals are dropped */
+  send_signal(pid, NUM_SIGNALS);
+  if (pcb->sig_pending)
+    TEST_FAIL;
+
+  /* Kernel memory is never a valid place for a signal frame */
+  if (!bad_userspace_addr(&kernel_word, sizeof(kernel_word)) ||
+      !bad_userspace_addr((void*)LOAD_ADDR, ADDRESS_SIZE))
+    TEST_FAIL;
+
+  TEST_END;
+}
+
+/* Wait Queue Test
+ *
+ * Registers on queues the way poll does and checks wake ups and cleanup
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Changes the state of the last pid's PCB
+ * Coverage: wake_up, poll_wait, poll_table_release
+ */
+TEST(WAIT_QUEUE) {
+  u32 const pid = MAX_PID_COUNT - 1;
+  Pcb* const pcb = get_pcb(pid);
+  u32 const self = 1U << get_current_pcb()->pid;
+  WaitQueue a, b;
+  PollTable pt;
+
+  init_wait_queue(&a);
+  init_wait_queue(&b);
+  pt.cnt = 0;
+
+  /* A blocked task is made runnable and leaves the queue */
+  a.waiters = 1U << pid;
+  pcb->state = TASK_INTERRUPTIBLE;
+  wake_up(&a);
+
+  if (pcb->state != TASK_RUNNING || a.waiters)
+    TEST_FAIL;
+
+  /* Polling registers on every queue and releasing leaves all of them */
+  poll_wait(&a, &pt);
+  poll_wait(&b, &pt);
+  poll_wait(&b, NULL);
+
+  if (pt.cnt != 2 || a.waiters != self || b.waiters != self)
+    TEST_FAIL;
+
+  poll_table_release(&pt);
+
+  if (pt.cnt || a.waiters || b.waiters)
+    TEST_FAIL;
+
+  TEST_END;
+}
+
+/* Run Queue Test
+ *
+ * Pushes and pops pids through a run queue's ring buffer
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: rq_push, rq_pop, rq_remove, FIFO order, wrap-around, full/empty queues
+ */
+TEST(RUN_QUEUE) {
+  RunQueue rq;
+  u32 i;
+
+  rq_init(&rq);
+
+  if (rq_pop(&rq) != -1)
+    TEST_FAIL;
+
+  /* Offset the head so the second fill wraps around the end of the buffer */
+  for (i = 0; i < RUNQUEUE_SIZE / 2; ++i)
+    if (rq_push(&rq, (u8)i) || rq_pop(&rq) != (i32)i)
+      TEST_FAIL;
+
+  for (i = 0; i < RUNQUEUE_SIZE; ++i)
+    if (rq_push(&rq, (u8)i))
+      TEST_FAIL;
+
+  if (rq_push(&rq, 0) != -1)
+    TEST_FAIL;
+
+  for (i = 0; i < RUNQUEUE_SIZE; ++i)
+    if (rq_pop(&rq) != (i32)i)
+      TEST_FAIL;
+
+  if (rq_pop(&rq) != -1)
+    TEST_FAIL;
+
+  /* Removing from the middle of a wrapped queue keeps the rest in order */
+  for (i = 0; i < 3; ++i)
+    rq_push(&rq, (u8)i);
+
+  if (rq_remove(&rq, 1) || rq_remove(&rq, 1) != -1 || rq_pop(&rq) != 0 || rq_pop(&rq) != 2 ||
+      rq_pop(&rq) != -1)
+    TEST_FAIL;
+
+  TEST_END;
+}
+
+/* Nice Test
+ *
+ * Changes the current process' niceness and checks the clamping
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None, the niceness and priority are restored
+ * Coverage: nice, priority floor, quantum growth between levels
+ */
+TEST(NICE) {
+  Pcb* const pcb = get_current_pcb();
+  u8 const old_nice = pcb->nice, old_prio = pcb->prio;
+  u32 i;
+
+  pcb->nice = 0;
+  pcb->prio = 0;
+
+  if (nice(0) != 0 || nice(-1) != 0 || nice(1) != 1 || pcb->prio != 1)
+    TEST_FAIL;
+
+  if (nice(NUM_PRIO_LEVELS) != NUM_PRIO_LEVELS - 1 || nice(-NUM_PRIO_LEVELS) != 0)
+    TEST_FAIL;
+
+  /* Increments that would overflow when added still clamp */
+  if (nice(0x7FFFFFFF) != NUM_PRIO_LEVELS - 1 || nice((i32)0x80000000) != 0)
+    TEST_FAIL;
+
+  for (i = 1; i < NUM_PRIO_LEVELS; ++i)
+    if (sched_quantum((u8)i) <= sched_quantum((u8)(i - 1)))
+      TEST_FAIL;
+
+  pcb->nice = old_nice;
+  pcb->prio = old_prio;
+  TEST_END;
+}
+
+/* SMP Test
+ *
+ * Checks every listed CPU came up with its own TSS and local APIC
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: init_smp, ap_main, this_cpu
+ */
+TEST(SMP) {
+  u32 i;
+
+  if (this_cpu() != &cpus[0] || get_cpus_online() != get_num_cpus())
+    TEST_FAIL;
+
+  for (i = 1; i < get_num_cpus(); ++i)
+    if (cpus[i].tss.esp0 == cpus[i - 1].tss.esp0 || cpus[i].apic_id == cpus[0].apic_id)
+      TEST_FAIL;
+
+  TEST_END;
+}
+
+/* APIC Test
+ *
+ * Checks the keyboard and RTC moved to the I/O APIC and the 8259 is out of the picture, and that
+ * every application processor's timer is ticking
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Waits a few ticks
+ * Coverage: init_apic_irqs, ioapic_enable_irq, i8259_to_ioapic, lapic_timer_calibrate,
+ *           lapic_timer_ap, irqh_ap_timer
+ */
+TEST(APIC) {
+  u32 const redir_mask = IOAPIC_MASKED | 0xFF; /* Mask bit and vector */
+  u32 ticks[MAX_CPUS];
+  u32 i;
+
+  /* Without both APICs the 8259 keeps delivering, which is fine too */
+  if (apic_irqs_enabled()) {
+    if ((ioapic_read_redir(KEYBOARD_IRQ) & redir_mask) != IDT_KEYBOARD ||
+        (ioapic_read_redir(RTC_IRQ) & redir_mask) != IDT_RTC)
+      TEST_FAIL;
+
+    if ((inb(MASTER_8259_DATA_PORT) & inb(SLAVE_8259_DATA_PORT)) != 0xFF)
+      TEST_FAIL;
+
+    if (!get_lapic_tick_count() || !lapic_timer_remaining())
+      TEST_FAIL;
+  }
+
+  if (get_lapic_tick_count()) {
+    for (i = 1; i < get_num_cpus(); ++i)
+      ticks[i] = cpus[i].ticks;
+
+    clock_delay_us(US_IN_SEC / PIT_HZ * 5);
+
+    for (i = 1; i < get_num_cpus(); ++i)
+      if (cpus[i].online && cpus[i].ticks == ticks[i])
+        TEST_FAIL_MSG("CPU %u", i);
+  }
+
+  TEST_END;
+}
+
+/* Frame Allocator Test
+ *
+ * Allocates, uses and frees 4KB and 4MB frames
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None, everything is given back
+ * Coverage: frame_alloc, frame_free, frame_alloc_4m, frame_free_4m, direct map
+ */
+TEST(FRAMES) {
+  u32 const nfree = frames_free();
+  u32 a, b, big;
+
+  if (!frames_total() || nfree > frames_total())
+    TEST_FAIL;
+
+  if (!(a = frame_alloc()) || !(b = frame_alloc()) || a == b)
+    TEST_FAIL;
+
+  /* Page-aligned, above the kernel, inside the direct map */
+  if (a % FRAME_SIZE || a < FRAME_RESERVED_END || a >= (u32)DIRECT_MAP_END_PG * PG_4M_START ||
+      frames_free() != nfree - 2)
+    TEST_FAIL;
+
+  memset((void*)a, 0xA5, FRAME_SIZE);
+  if (((u8*)a)[FRAME_SIZE - 1] != 0xA5)
+    TEST_FAIL;
+
+  frame_free(a);
+  frame_free(b);
+  frame_free(b); /* Double frees are ignored */
+  if (frames_free() != nfree)
+    TEST_FAIL;
+
+  /* There may not be a whole 4MB frame to spare, but if there is it must be aligned */
+  if ((big = frame_alloc_4m())) {
+    if (big % PG_4M_START || frames_free() != nfree - FRAMES_PER_4M)
+      TEST_FAIL;
+
+    ((u8*)big)[PG_4M_START - 1] = 0x5A;
+    frame_free_4m(big);
+    frame_free_4m(big); /* So are double frees of a whole run */
+  }
+
+  if (frames_free() != nfree)
+    TEST_FAIL;
+
+  TEST_END;
+}
+
+/* Slab Allocator Test
+ *
+ * Allocates from a cache until it needs a second slab, then frees everything
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Registers a "test" cache, which can't be destroyed; prints every cache's usage
+ * Coverage: kmem_cache_create, kmem_cache_alloc, kmem_cache_free, kmalloc, kfree
+ */
+TEST(SLAB) {
+  static KmemCache* cache;
+  u32 const nfree = frames_free();
+  void* objs[FRAME_SIZE / SLAB_ALIGN];
+  u8* small;
+  u8* big;
+  u32 i, slabs;
+
+  if (!cache && !(cache = kmem_cache_create("test", 24)))
+    TEST_FAIL;
+
+  /* A previous run leaves one empty slab behind */
+  slabs = cache->nr_slabs;
+
+  if (cache->obj_size != 24 || cache->per_slab >= sizeof(objs) / sizeof(*objs))
+    TEST_FAIL;
+
+  /* One more than a slab holds */
+  for (i = 0; i <= cache->per_slab; ++i) {
+    if (!(objs[i] = kmem_cache_alloc(cache)) || (u32)objs[i] % SLAB_ALIGN)
+      TEST_FAIL;
+
+    memset(objs[i], (i32)i, cache->obj_size);
+  }
+
+  if (cache->nr_slabs != 2 || cache->nr_inuse != cache->per_slab + 1)
+    TEST_FAIL;
+
+  for (i = 0; i <= cache->per_slab; ++i)
+    if (*((u8*)objs[i] + cache->obj_size - 1) != (u8)i)
+      TEST_FAIL;
+
+  for (i = 0; i <= cache->per_slab; ++i)
+    kmem_cache_free(cache, objs[i]);
+
+  /* The slab that emptied first goes back; the last one is kept for next time */
+  if (cache->nr_slabs != 1 || cache->nr_inuse || frames_free() != nfree - (1 - slabs))
+    TEST_FAIL;
+
+  /* Small requests come from a size class, page-sized ones are whole frames */
+  if (!(small = kmalloc(100)) || !((u32)small % FRAME_SIZE) || !(big = kmalloc(FRAME_SIZE)) ||
+      (u32)big % FRAME_SIZE || kmalloc(0) || kmalloc(FRAME_SIZE + 1))
+    TEST_FAIL;
+
+  big[FRAME_SIZE - 1] = small[99] = 0x5A;
+  kfree(small);
+  kfree(big);
+  kfree(NULL);
+
+  kmalloc_stats_print();
+
+  TEST_END;
+}
+
+/* Spinlock Test
+ *
+ * Takes and releases a lock, with and without interrupts disabled
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: With LOCK_STATS, registers the test lock and prints every lock's counters
+ * Coverage: spin_lock, spin_trylock, spin_unlock, spin_lock_irqsave, spin_unlock_irqrestore
+ */
+TEST(SPINLOCK) {
+  static Spinlock lock; /* Stays registered for lock_stats_print after we return */
+  u32 flags, inner;
+
+  spin_init(&lock, "test");
+
+  if (spin_is_locked(&lock))
+    TEST_FAIL;
+
+  spin_lock(&lock);
+  if (!spin_is_locked(&lock) || spin_trylock(&lock))
+    TEST_FAIL;
+
+  spin_unlock(&lock);
+  if (spin_is_locked(&lock) || !spin_trylock(&lock))
+    TEST_FAIL;
+
+  spin_unlock(&lock);
+
+  /* Interrupts are off while held and come back exactly as they were */
+  spin_lock_irqsave(&lock, flags);
+  asm volatile("pushfl; popl %0" : "=r"(inner));
+  spin_unlock_irqrestore(&lock, flags);
+
+  if ((inner & EFLAGS_IF) || spin_is_locked(&lock))
+    TEST_FAIL;
+
+  asm volatile("pushfl; popl %0" : "=r"(inner));
+  if ((inner ^ flags) & EFLAGS_IF)
+    TEST_FAIL;
+
+#if LOCK_STATS
+  if (lock.acquired != 3 || lock.contended)
+    TEST_FAIL;
+
+  lock_stats_print();
+#endif
+
+  TEST_END;
+}
+
+/* Pipe Test
+ *
+ * Sends data through a pipe within the current process
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Uses two of the current process' descriptors and a pipe, both freed again
+ * Coverage: pipe, pipe read/write wrap-around, end-of-file, writing with no readers
+ */
+TEST(PIPE) {
+  u8 data[PIPE_BUF_SIZE / 2 + 1];
+  u8 out[sizeof(data)];
+  i32 fds[2];
+  u32 i;
+
+  for (i = 0; i < sizeof(data); ++i)
+    data[i] = (u8)i;
+
+  if (pipe(fds) || fds[0] < FD_START || fds[1] < FD_START || fds[0] == fds[1])
+    TEST_FAIL;
+
+  /* The second round wraps around the end of the buffer */
+  for (i = 0; i < 2 * sizeof(data); ++i) {
+    if (!(i % sizeof(data))) {
+      memset(out, 0, sizeof(out));
+
+      if (write(fds[1], data, sizeof(data)) != sizeof(data) ||
+          read(fds[0], out, sizeof(out)) != sizeof(out))
+        TEST_FAIL;
+    }
+
+    if (out[i % sizeof(data)] != data[i % sizeof(data)])
+      TEST_FAIL;
+  }
+
+  /* Reads see end-of-file once the writer is gone */
+  if (write(fds[1], data, 1) != 1 || close(fds[1]) || read(fds[0], out, sizeof(out)) != 1 ||
+      read(fds[0], out, sizeof(out)) != 0)
+    TEST_FAIL;
+
+  close(fds[0]);
+
+  /* Writes fail once the reader is gone */
+  if (pipe(fds) || close(fds[0]) || write(fds[1], data, 1) != -1)
+    TEST_FAIL;
+
+  close(fds[1]);
+  TEST_END;
+}
+
+/***** }}} SCHEDULING *****/
+
+/***** MEMORY {{{ *****/
+
+/* Shared Memory Test
+ *
+ * Creates segments as the current process and releases them
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Resets shared memory state
+ * Coverage: shm_create key lookup, pool allocation, shm_exit freeing
+ */
+TEST(SHM) {
+  u32 const pid = get_current_pcb()->pid;
+  i32 a, b;
+
+  init_shm();
+
+  a = shm_create(391, SHM_PAGE_SIZE + 1);
+  b = shm_create(392, SHM_PAGE_SIZE);
+
+  if (a < 0 || b < 0 || a == b)
+    TEST_FAIL;
+
+  /* Same key finds the same segment, as long as it's big enough */
+  if (shm_create(391, SHM_PAGE_SIZE) != a || shm_create(391, SHM_PAGE_SIZE * 3) != -1)
+    TEST_FAIL;
+
+  if (!shm_create(393, 0) || shm_create(393, SHM_POOL_PAGES * SHM_PAGE_SIZE) != -1)
+    TEST_FAIL;
+
+  /* Exiting frees both, so the whole pool is available again */
+  shm_exit(pid);
+
+  if ((a = shm_create(394, SHM_POOL_PAGES * SHM_PAGE_SIZE)) < 0)
+    TEST_FAIL;
+
+  shm_exit(pid);
+  TEST_END;
+}
+
+/* Process Page Directory Test
+ *
+ * Builds and tears down an address space for an unused pid
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Briefly runs on the new page directory; does nothing if the last pid is in use
+ * Coverage: make_task_pgdir, remove_task_pgdir, map_kernel_pdes
+ */
+TEST(TASK_PGDIR) {
+  u8 const proc = NUM_PROC - 1;
+  u32 const nfree = frames_free();
+  u32 const* dir;
+
+  if (!get_task(proc)) {
+    if (make_task_pgdir(proc) || make_task_pgdir(proc) != -1)
+      TEST_FAIL;
+
+    /* Loaded, from the frame allocator, sharing the kernel's entries */
+    asm volatile("mov %%cr3, %0" : "=r"(dir));
+    if (dir == pgdir || (u32)dir < FRAME_RESERVED_END || (dir[1] ^ pgdir[1]) & PDE_USED_4M ||
+        (dir[APIC_PG] ^ pgdir[APIC_PG]) & PDE_USED_4M || dir[ELF_LOAD_PG])
+      TEST_FAIL;
+
+    if (remove_task_pgdir(proc) || remove_task_pgdir(proc) != -1)
+      TEST_FAIL;
+
+    /* Back on the kernel's, with every frame given back */
+    asm volatile("mov %%cr3, %0" : "=r"(dir));
+    if (dir != pgdir || frames_free() != nfree)
+      TEST_FAIL;
+
+    flush_tlb();
+  }
+
+  TEST_END;
+}
+
+/* Heap Test
+ *
+ * Grows and shrinks the current process' heap
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: May leave a page table behind for the heap, freed when the process exits
+ * Coverage: sbrk, map_user_page, unmap_user_page
+ */
+TEST(HEAP) {
+  Pcb* const pcb = get_current_pcb();
+  u32 const saved = pcb->brk;
+  u32 nfree;
+
+  pcb->brk = HEAP_START;
+
+  if (sbrk(0) != HEAP_START || sbrk(-1) != -1)
+    TEST_FAIL;
+
+  /* Two pages, plus a page table the first time */
+  nfree = frames_free();
+  if (sbrk(FRAME_SIZE + 1) != HEAP_START || pcb->brk != HEAP_START + FRAME_SIZE + 1 ||
+      nfree - frames_free() < 2 || nfree - frames_free() > 3)
+    TEST_FAIL;
+
+  nfree = frames_free();
+  if (sbrk(-(FRAME_SIZE + 1)) != HEAP_START + FRAME_SIZE + 1 || frames_free() != nfree + 2)
+    TEST_FAIL;
+
+  /* Past the end of the window fails without moving the break */
+  if (sbrk(HEAP_END - HEAP_START + 1) != -1 || pcb->brk != HEAP_START)
+    TEST_FAIL;
+
+  pcb->brk = saved;
+  TEST_END;
+}
+
+/* Program Image Test
+ *
+ * Maps one program into two unused pids and faults pages into one of them
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Leaves shell's image cached; does nothing if either of the last two pids is in use
+ * Coverage: map_image, release_image, handle_page_fault, get_user_pte
+ */
+TEST(IMAGE) {
+  u8 const a = NUM_PROC - 1, b = NUM_PROC - 2;
+  u32 const* page;
+  DirEntry dentry;
+  u32 nfree, pte, i;
+
+  if (!get_task(a) && !get_task(b)) {
+    if (read_dentry_by_name((u8 const*)"shell", &dentry))
+      TEST_FAIL;
+
+    /* Once cached, a launch only costs the directory and two page tables */
+    if (make_task_pgdir(a) || map_image(a, dentry.inode_idx) || remove_task_pgdir(a))
+      TEST_FAIL;
+
+    nfree = frames_free();
+    if (make_task_pgdir(a) || map_image(a, dentry.inode_idx) ||
+        map_image(a, dentry.inode_idx) != -1 || nfree - frames_free() != 3 ||
+        make_task_pgdir(b) || map_image(b, dentry.inode_idx))
+      TEST_FAIL;
+
+    /* Both share the same read-only frame */
+    pte = get_user_pte(a, LOAD_ADDR);
+    if (!(pte & PG_COW) || (pte & PG_RW) || pte != get_user_pte(b, LOAD_ADDR))
+      TEST_FAIL;
+
+    /* Reads of a present page are real faults; a write copies it */
+    if (handle_page_fault(b, LOAD_ADDR, PF_PRESENT | PF_USER) != -1 ||
+        handle_page_fault(b, LOAD_ADDR + 1, PF_PRESENT | PF_WRITE | PF_USER) ||
+        get_user_pte(a, LOAD_ADDR) != pte || !(get_user_pte(b, LOAD_ADDR) & PG_RW) ||
+        (get_user_pte(b, LOAD_ADDR) & PG_COW))
+      TEST_FAIL;
+
+    page = (u32 const*)(get_user_pte(b, LOAD_ADDR) & ~(PTE_SIZE - 1));
+    for (i = 0; i < FRAME_SIZE / sizeof(*page); ++i)
+      if (page[i] != ((u32 const*)(pte & ~(PTE_SIZE - 1)))[i])
+        TEST_FAIL;
+
+    /* The rest of the window is zero-filled on demand; nothing outside it is */
+    if (get_user_pte(b, ELF_WINDOW_START) || handle_page_fault(b, ELF_WINDOW_START, PF_USER) ||
+        handle_page_fault(b, ELF_WINDOW_END, PF_USER) != -1)
+      TEST_FAIL;
+
+    page = (u32 const*)(get_user_pte(b, ELF_WINDOW_START) & ~(PTE_SIZE - 1));
+    for (i = 0; i < FRAME_SIZE / sizeof(*page); ++i)
+      if (page[i])
+        TEST_FAIL;
+
+    /* Private pages are freed, the shared ones stay with the cache */
+    if (remove_task_pgdir(b) || remove_task_pgdir(a) || frames_free() != nfree)
+      TEST_FAIL;
+
+    flush_tlb();
+  }
+
+  TEST_END;
+}
+
+/* Zeroed Frame Pool Test
+ *
+ * Fills the pool the way the idle path does and takes a frame from it
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Leaves the pool full
+ * Coverage: zero_pool_refill, alloc_zeroed_frame, zero_pool_count
+ */
+TEST(ZERO_POOL) {
+  u32 const* page;
+  u32 nfree, frame, i;
+
+  while (zero_pool_refill())
+    ;
+
+  /* Only short of full if memory is */
+  if (zero_pool_count() != ZERO_POOL_SIZE && frames_free() > ZERO_POOL_RESERVE)
+    TEST_FAIL;
+
+  /* Taken from the pool, so the frame allocator isn't touched */
+  nfree = frames_free();
+  if (!(frame = alloc_zeroed_frame()) || frames_free() != nfree ||
+      zero_pool_count() != ZERO_POOL_SIZE - 1)
+    TEST_FAIL;
+
+  page = (u32 const*)frame;
+  for (i = 0; i < FRAME_SIZE / sizeof(*page); ++i)
+    if (page[i])
+      TEST_FAIL;
+
+  frame_free(frame);
+
+  if (zero_pool_refill() != 1 || zero_pool_count() != ZERO_POOL_SIZE)
+    TEST_FAIL;
+
+  TEST_END;
+}
+
+/* User Stack Test
+ *
+ * Grows an unused pid's stack from the top of its window down to the guard page
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Briefly runs on the new page directory; does nothing if the last pid is in use
+ * Coverage: handle_page_fault, is_demand_paged, remove_task_pgdir
+ */
+TEST(USER_STACK) {
+  u8 const proc = NUM_PROC - 1;
+  u32 nfree;
+
+  if (!get_task(proc)) {
+    /* Pool frames count as free, since they go back to the frame allocator when unmapped */
+    nfree = frames_free() + zero_pool_count();
+
+    if (make_task_pgdir(proc) || get_user_pte(proc, USER_STACK_TOP))
+      TEST_FAIL;
+
+    /* The first push maps the top page; a deep one maps just the page it touches */
+    if (handle_page_fault(proc, USER_STACK_TOP, PF_WRITE | PF_USER) ||
+        !(get_user_pte(proc, USER_STACK_TOP) & PG_RW) ||
+        handle_page_fault(proc, STACK_LIMIT, PF_WRITE | PF_USER) ||
+        get_user_pte(proc, STACK_LIMIT + PTE_SIZE))
+      TEST_FAIL;
+
+    /* Running off the end hits the guard page, which is never mapped */
+    if (handle_page_fault(proc, STACK_LIMIT - 1, PF_WRITE | PF_USER) != -1 ||
+        get_user_pte(proc, STACK_LIMIT - 1) || is_demand_paged(STACK_WINDOW_START))
+      TEST_FAIL;
+
+    if (remove_task_pgdir(proc) || frames_free() + zero_pool_count() != nfree)
+      TEST_FAIL;
+
+    flush_tlb();
+  }
+
+  TEST_END;
+}
+
+/* PAT Test
+ *
+ * Checks VGA memory is mapped write-combining when the CPU can do it
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: init_pat, init_paging
+ */
+TEST(PAT) {
+  u32 eax, ebx, ecx, edx, lo, hi;
+
+  asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(CPUID_FEAT));
+
+  if (VIDMEM_WC && (edx & CPUID_EDX_PAT)) {
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(MSR_PAT));
+    if (((lo >> PAT_ENTRY_BITS) & 0xFF) != PAT_WC)
+      TEST_FAIL;
+
+    /* Only video memory selects the entry */
+    if ((pgtbl[PG_VIDMEM_START] & (PG_PAT_WC | PG_PCD)) != PG_PAT_WC ||
+        (pgtbl[PG_VIDMEM_START + 1] & PG_PAT_WC))
+      TEST_FAIL;
+  }
+
+  TEST_END;
+}
+
+/***** }}} MEMORY *****/
+
 /* Test suite entry point */
 void launch_tests(void) {
 #if TESTS_ENABLED
@@ -528,5 +1501,28 @@ void launch_tests(void) {
 
   TEST_EXEC_LS();
   TEST_EXEC_TESTPRINT();
+
+  TEST_TIMER();
+  TEST_NOHZ();
+  TEST_CLOCK();
+  TEST_ACCT();
+  TEST_FPU();
+  TEST_SIGNALS();
+  TEST_WAIT_QUEUE();
+  TEST_RUN_QUEUE();
+  TEST_NICE();
+  TEST_SMP();
+  TEST_APIC();
+  TEST_SPINLOCK();
+  TEST_FRAMES();
+  TEST_SLAB();
+  TEST_PIPE();
+  TEST_SHM();
+  TEST_TASK_PGDIR();
+  TEST_HEAP();
+  TEST_IMAGE();
+  TEST_ZERO_POOL();
+  TEST_USER_STACK();
+  TEST_PAT();
 #endif
 }
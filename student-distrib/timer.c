@@ -0,0 +1,276 @@
+#include "timer.h"
+#include "lib.h"
+#include "pit.h"
+
+/* Index into outer wheel `lvl` for a given tick */
+#define TVN_INDEX(tick, lvl) (((tick) >> (TVR_BITS + (lvl)*TVN_BITS)) & TVN_MASK)
+
+/* Root wheel holds the next TVR_SIZE ticks, each outer wheel covers TVN_SIZE times more */
+static Timer* tv_root[TVR_SIZE];
+static Timer* tv_outer[TVN_CNT][TVN_SIZE];
+
+/* Ticks since boot, advanced by the PIT */
+static u32 volatile ticks = 0;
+
+/* Next tick the wheel has not yet processed */
+static u32 timer_base = 0;
+
+static void timer_list_add(Timer** head, Timer* timer);
+static void timer_list_del(Timer* timer);
+static void internal_add_timer(Timer* timer);
+static u32 cascade(u32 lvl, u32 idx);
+
+/* timer_list_add
+ * Description: Pushes a timer onto the front of a wheel slot
+ * Inputs: head -- slot to add to
+ *         timer -- timer to add
+ * Outputs: none
+ * Return Value: none
+ * Function: Links the timer in so it can later be removed in O(1)
+ */
+static void timer_list_add(Timer** const head, Timer* const timer) {
+  timer->next = *head;
+  if (*head)
+    (*head)->pprev = &timer->next;
+
+  *head = timer;
+  timer->pprev = head;
+}
+
+/* timer_list_del
+ * Description: Unlinks a timer from whichever wheel slot it is in
+ * Inputs: timer -- timer to remove
+ * Outputs: none
+ * Return Value: none
+ * Function: Patches the previous link to skip the timer and marks it as not pending
+ */
+static void timer_list_del(Timer* const timer) {
+  *timer->pprev = timer->next;
+  if (timer->next)
+    timer->next->pprev = timer->pprev;
+
+  timer->next = NULL;
+  timer->pprev = NULL;
+}
+
+/* internal_add_timer
+ * Description: Places a timer in the wheel slot matching its deadline
+ * Inputs: timer -- timer to place
+ * Outputs: none
+ * Return Value: none
+ * Function: Timers due within TVR_SIZE ticks go in the root wheel, the rest are bucketed into the
+ *           outer wheel whose range covers them and get cascaded inwards as time passes
+ */
+static void internal_add_timer(Timer* const timer) {
+  u32 const expires = timer->expires;
+  u32 const idx = expires - timer_base;
+  u32 lvl;
+
+  /* Already due, run it on the next tick */
+  if ((i32)idx < 0) {
+    timer_list_add(&tv_root[timer_base & TVR_MASK], timer);
+    return;
+  }
+
+  if (idx < TVR_SIZE) {
+    timer_list_add(&tv_root[expires & TVR_MASK], timer);
+    return;
+  }
+
+  /* The last wheel covers whatever is left of the 32-bit range */
+  for (lvl = 0; lvl < TVN_CNT - 1; ++lvl)
+    if (idx < 1U << (TVR_BITS + (lvl + 1) * TVN_BITS))
+      break;
+
+  timer_list_add(&tv_outer[lvl][TVN_INDEX(expires, lvl)], timer);
+}
+
+/* cascade
+ * Description: Redistributes one outer wheel slot into the wheels below it
+ * Inputs: lvl -- outer wheel to cascade from
+ *         idx -- slot to cascade
+ * Outputs: none
+ * Return Value: idx, so the caller knows whether the next wheel up also wrapped
+ * Function: Re-adds every timer in the slot relative to the current timer_base
+ */
+static u32 cascade(u32 const lvl, u32 const idx) {
+  Timer* timer = tv_outer[lvl][idx];
+
+  tv_outer[lvl][idx] = NULL;
+
+  while (timer) {
+    Timer* const next = timer->next;
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+    internal_add_timer(timer);
+    timer = next;
+  }
+
+  return idx;
+}
+
+/* init_timers
+ * Description: Initializes the timer wheel
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Empties every wheel slot and resets the tick count
+ */
+void init_timers(void) {
+  memset(tv_root, 0, sizeof(tv_root));
+  memset(tv_outer, 0, sizeof(tv_outer));
+  ticks = 0;
+  timer_base = 0;
+}
+
+/* init_timer
+ * Description: Prepares a timer for use
+ * Inputs: timer -- timer to initialize
+ *         fn -- callback to run (in interrupt context) when the timer expires
+ *         data -- argument passed to fn
+ * Outputs: none
+ * Return Value: none
+ * Function: Sets the callback and marks the timer as not pending
+ */
+void init_timer(Timer* const timer, TimerFn const fn, u32 const data) {
+  timer->next = NULL;
+  timer->pprev = NULL;
+  timer->expires = 0;
+  timer->fn = fn;
+  timer->data = data;
+}
+
+/* add_timer
+ * Description: Arms a timer
+ * Inputs: timer -- timer to arm
+ *         expires -- absolute tick at which to fire
+ * Outputs: none
+ * Return Value: none
+ * Function: Re-arms the timer if it was already pending
+ */
+void add_timer(Timer* const timer, u32 const expires) {
+  u32 flags;
+
+  if (!timer || !timer->fn)
+    return;
+
+  cli_and_save(flags);
+
+  /* The PIT may be programmed to sleep past the new deadline */
+  tick_nohz_stop();
+
+  if (timer->pprev)
+    timer_list_del(timer);
+
+  timer->expires = expires;
+  internal_add_timer(timer);
+
+  restore_flags(flags);
+}
+
+/* del_timer
+ * Description: Disarms a timer
+ * Inputs: timer -- timer to disarm
+ * Outputs: none
+ * Return Value: none
+ * Function: Removes the timer from the wheel if it has not fired yet
+ */
+void del_timer(Timer* const timer) {
+  u32 flags;
+
+  if (!timer)
+    return;
+
+  cli_and_save(flags);
+
+  if (timer->pprev)
+    timer_list_del(timer);
+
+  restore_flags(flags);
+}
+
+/* timer_pending
+ * Description: Checks whether a timer is armed
+ * Inputs: timer -- timer to check
+ * Outputs: none
+ * Return Value: 1 if armed, 0 otherwise
+ * Function: A timer is armed while it is linked into a wheel slot
+ */
+i32 timer_pending(Timer const* const timer) { return timer && timer->pprev; }
+
+/* run_timers
+ * Description: Advances the wheel by one tick. Called from the PIT interrupt.
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: Cascades outer wheels whenever the root wheel wraps and runs every timer whose
+ *           deadline has been reached
+ */
+void run_timers(void) {
+  ++ticks;
+
+  while ((i32)(ticks - timer_base) >= 0) {
+    u32 const idx = timer_base & TVR_MASK;
+    Timer* expired;
+    Timer* timer;
+
+    /* Only pull the next outer wheel in when the one below it has wrapped */
+    if (!idx && !cascade(0, TVN_INDEX(timer_base, 0)) && !cascade(1, TVN_INDEX(timer_base, 1)) &&
+        !cascade(2, TVN_INDEX(timer_base, 2)))
+      cascade(3, TVN_INDEX(timer_base, 3));
+
+    ++timer_base;
+
+    /* Detach the slot first so callbacks can safely re-arm or delete timers */
+    expired = tv_root[idx];
+    tv_root[idx] = NULL;
+    if (expired)
+      expired->pprev = &expired;
+
+    while (expired) {
+      timer = expired;
+      timer_list_del(timer);
+      timer->fn(timer->data);
+    }
+  }
+}
+
+/* get_ticks
+ * Description: Gets the number of PIT ticks since boot
+ * Inputs: none
+ * Outputs: none
+ * Return Value: tick count
+ * Function: Returns the tick count
+ */
+u32 get_ticks(void) { return ticks; }
+
+/* next_timer_tick
+ * Description: Finds the first tick a timer could be due on
+ * Inputs: limit -- tick to stop looking at
+ * Outputs: none
+ * Return Value: the tick, or limit if nothing is due before it
+ * Function: Scans the root wheel. Stops early where it wraps, since the outer wheel cascaded in
+ *           then may hold timers for the ticks after it.
+ */
+u32 next_timer_tick(u32 const limit) {
+  u32 t;
+
+  for (t = timer_base; (i32)(t - limit) < 0; ++t)
+    if (tv_root[t & TVR_MASK] || !(t & TVR_MASK))
+      return t;
+
+  return limit;
+}
+
+/* ms_to_ticks
+ * Description: Converts milliseconds to PIT ticks
+ * Inputs: ms -- number of milliseconds
+ * Outputs: none
+ * Return Value: number of ticks, rounded up
+ * Function: Rounds up so a timer never fires early
+ */
+u32 ms_to_ticks(u32 const ms) {
+  /* Split into whole seconds first so large values don't overflow */
+  return (ms / MS_IN_SEC) * PIT_HZ + ((ms % MS_IN_SEC) * PIT_HZ + MS_IN_SEC - 1) / MS_IN_SEC;
+}
@@ -0,0 +1,37 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "types.h"
+
+/* Hierarchical timer wheel (one root wheel plus cascading outer wheels) */
+enum {
+  TVR_BITS = 8,
+  TVN_BITS = 6,
+  TVR_SIZE = 1 << TVR_BITS,
+  TVN_SIZE = 1 << TVN_BITS,
+  TVR_MASK = TVR_SIZE - 1,
+  TVN_MASK = TVN_SIZE - 1,
+  TVN_CNT = 4 /* TVR_BITS + TVN_CNT * TVN_BITS covers the full 32-bit tick range */
+};
+
+typedef void (*TimerFn)(u32 data);
+
+typedef struct Timer {
+  struct Timer* next;
+  struct Timer** pprev;
+  u32 expires;
+  TimerFn fn;
+  u32 data;
+} Timer;
+
+void init_timers(void);
+void init_timer(Timer* timer, TimerFn fn, u32 data);
+void add_timer(Timer* timer, u32 expires);
+void del_timer(Timer* timer);
+i32 timer_pending(Timer const* timer);
+void run_timers(void);
+u32 get_ticks(void);
+u32 next_timer_tick(u32 limit);
+u32 ms_to_ticks(u32 ms);
+
+#endif
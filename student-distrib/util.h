@@ -8,6 +8,7 @@
 #define ALWAYS_INLINE __attribute__((always_inline))
 #define NOINLINE __attribute__((noinline))
 #define PACKED __attribute__((packed))
+#define ALIGNED(x) __attribute__((aligned(x)))
 #define UNUSED(x) x##_UNUSED __attribute__((unused))
 #define NONNULL(x) __attribute__((nonnull x))
 #define HLTLOOP asm volatile("1: hlt; jmp 1b")
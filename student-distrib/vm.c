@@ -0,0 +1,410 @@
+#include "vm.h"
+#include "frame.h"
+#include "fs.h"
+#include "kmalloc.h"
+#include "lib.h"
+#include "syscall.h"
+#include "util.h"
+
+static Image images[MAX_IMAGES];
+static Image* task_image[NUM_PROC]; /* Image each process has mapped, NULL if none */
+static u32 image_clock;
+static Spinlock image_lock;
+
+/* Zeroed frames, filled at idle time and taken by demand-zero faults */
+static u32 zero_pool[ZERO_POOL_SIZE];
+static u32 zero_pool_cnt;
+static Spinlock zero_pool_lock;
+
+static u32 alloc_frame(void);
+static u32 zero_pool_take(void);
+static u32 drop_idle_images(void);
+static void drop_image(Image* img);
+static Image* find_image(u32 inode);
+static u32* read_image(u32 inode, u32 size);
+static Image* get_image(u32 inode, u32 size);
+
+/* init_vm
+ * Description: Sets up the program image cache
+ * Inputs: none
+ * Outputs: none
+ * Return Value: none
+ * Function: The cache starts out empty; images are read in by the first process to run them.
+ *           The zeroed frame pool starts out empty too and is filled when the CPU goes idle.
+ */
+void init_vm(void) {
+  spin_init(&image_lock, "image");
+  spin_init(&zero_pool_lock, "zero pool");
+}
+
+/* alloc_frame
+ * Description: Gets a frame for a user page
+ * Inputs: none
+ * Outputs: none
+ * Return Value: physical address of the frame (not zeroed), 0 if memory is full
+ * Function: Idle cached images are only worth keeping while memory is plentiful, so if the
+ *           frame allocator runs dry they are dropped and the allocation is tried once more.
+ *           Failing that, the zeroed frame pool gives up one of its frames.
+ */
+static u32 alloc_frame(void) {
+  u32 frame = frame_alloc();
+
+  if (frame || (drop_idle_images() && (frame = frame_alloc())))
+    return frame;
+
+  return zero_pool_take();
+}
+
+/* zero_pool_take
+ * Description: Takes a frame out of the zeroed frame pool
+ * Inputs: none
+ * Outputs: none
+ * Return Value: physical address of a zeroed frame, 0 if the pool is empty
+ * Function: none
+ */
+static u32 zero_pool_take(void) {
+  u32 flags, frame = 0;
+
+  spin_lock_irqsave(&zero_pool_lock, flags);
+
+  if (zero_pool_cnt)
+    frame = zero_pool[--zero_pool_cnt];
+
+  spin_unlock_irqrestore(&zero_pool_lock, flags);
+  return frame;
+}
+
+/* drop_idle_images
+ * Description: Empties the cache of images no process is running
+ * Inputs: none
+ * Outputs: none
+ * Return Value: number of images dropped
+ * Function: Their frames go back to the frame allocator
+ */
+static u32 drop_idle_images(void) {
+  u32 flags, i, dropped = 0;
+
+  spin_lock_irqsave(&image_lock, flags);
+
+  for (i = 0; i < MAX_IMAGES; ++i)
+    if (images[i].frames && !images[i].users) {
+      drop_image(&images[i]);
+      ++dropped;
+    }
+
+  spin_unlock_irqrestore(&image_lock, flags);
+  return dropped;
+}
+
+/* drop_image
+ * Description: Frees an idle image's frames and its cache entry
+ * Inputs: img -- image nobody has mapped; image_lock held
+ * Outputs: none
+ * Return Value: none
+ * Function: none
+ */
+static void drop_image(Image* const img) {
+  u32 i;
+
+  for (i = 0; i < img->npages; ++i)
+    frame_free(img->frames[i]);
+
+  kfree(img->frames);
+  img->frames = NULL;
+}
+
+/* find_image
+ * Description: Looks up a file in the image cache
+ * Inputs: inode -- the program's inode; image_lock held
+ * Outputs: none
+ * Return Value: its image, NULL if it isn't cached
+ * Function: none
+ */
+static Image* find_image(u32 const inode) {
+  u32 i;
+
+  for (i = 0; i < MAX_IMAGES; ++i)
+    if (images[i].frames && images[i].inode == inode)
+      return &images[i];
+
+  return NULL;
+}
+
+/* read_image
+ * Description: Reads a program file into frames
+ * Inputs: inode -- the program's inode
+ *         size -- its size in bytes, more than 0
+ * Outputs: none
+ * Return Value: array of the frames, from kmalloc; NULL if memory is full or the read fails
+ * Function: The end of the last page past the file is zeroed, since that is where the program's
+ *           uninitialized data starts
+ */
+static u32* read_image(u32 const inode, u32 const size) {
+  u32 const npages = (size + FRAME_SIZE - 1) / FRAME_SIZE;
+  u32* const frames = kmalloc(npages * sizeof(*frames));
+  u32 i, j, len;
+
+  if (!frames)
+    return NULL;
+
+  for (i = 0; i < npages; ++i) {
+    len = MIN((u32)FRAME_SIZE, size - i * FRAME_SIZE);
+
+    if ((frames[i] = alloc_frame())) {
+      memset((void*)frames[i], 0, FRAME_SIZE);
+
+      if (read_data(inode, i * FRAME_SIZE, (u8*)frames[i], len) == (i32)len)
+        continue;
+    }
+
+    /* frame_free ignores the one we didn't get */
+    for (j = 0; j <= i; ++j)
+      frame_free(frames[j]);
+
+    kfree(frames);
+    return NULL;
+  }
+
+  return frames;
+}
+
+/* get_image
+ * Description: Gets a program's image, reading it in if it isn't cached
+ * Inputs: inode -- the program's inode
+ *         size -- its size in bytes, more than 0
+ * Outputs: none
+ * Return Value: the image with one more user, NULL on failure
+ * Function: The file is read without the lock held. If another process cached the same file in
+ *           the meantime, its copy is used and ours is thrown away. A new image replaces a free
+ *           entry, or else the one that has been idle longest.
+ */
+static Image* get_image(u32 const inode, u32 const size) {
+  Image* img;
+  Image* victim = NULL;
+  u32* frames;
+  u32 flags, i;
+
+  spin_lock_irqsave(&image_lock, flags);
+
+  if ((img = find_image(inode))) {
+    ++img->users;
+    spin_unlock_irqrestore(&image_lock, flags);
+    return img;
+  }
+
+  spin_unlock_irqrestore(&image_lock, flags);
+
+  if (!(frames = read_image(inode, size)))
+    return NULL;
+
+  spin_lock_irqsave(&image_lock, flags);
+
+  if (!(img = find_image(inode))) {
+    for (i = 0; i < MAX_IMAGES && !img; ++i)
+      if (!images[i].frames)
+        img = &images[i];
+      else if (!images[i].users && (!victim || images[i].last_used < victim->last_used))
+        victim = &images[i];
+
+    if (!img && (img = victim))
+      drop_image(img);
+
+    if (img) {
+      img->frames = frames;
+      img->inode = inode;
+      img->npages = (size + FRAME_SIZE - 1) / FRAME_SIZE;
+      img->users = 0;
+      frames = NULL;
+    }
+  }
+
+  if (img)
+    ++img->users;
+
+  spin_unlock_irqrestore(&image_lock, flags);
+
+  /* Lost the race (or, impossibly, every entry is in use): give ours back */
+  if (frames) {
+    for (i = 0; i < (size + FRAME_SIZE - 1) / FRAME_SIZE; ++i)
+      frame_free(frames[i]);
+    kfree(frames);
+  }
+
+  return img;
+}
+
+/* map_image
+ * Description: Maps a program into a new process' address space
+ * Inputs: proc -- the process, with a page directory and no image yet
+ *         inode -- the program's inode
+ * Outputs: none
+ * Return Value: -1 on failure, 0 on success
+ * Function: Every page of the file is mapped at LOAD_ADDR straight from the image cache,
+ *           read-only and copy-on-write, so processes running the same program share its text
+ *           and only copy the pages they write to. The rest of the program window is filled with
+ *           zeroed pages as it is touched. On failure the caller still removes the page directory,
+ *           which lets go of the image.
+ */
+i32 map_image(u8 const proc, u32 const inode) {
+  i32 const size = file_size(inode);
+  Image* img;
+  u32 i;
+
+  if (proc >= NUM_PROC || task_image[proc] || size <= 0 ||
+      (u32)size > (u32)ELF_WINDOW_END - LOAD_ADDR)
+    return -1;
+
+  if (!(img = get_image(inode, (u32)size)))
+    return -1;
+
+  task_image[proc] = img;
+
+  for (i = 0; i < img->npages; ++i)
+    if (map_user_page(proc, LOAD_ADDR + i * FRAME_SIZE, img->frames[i], PG_COW))
+      return -1;
+
+  return 0;
+}
+
+/* release_image
+ * Description: Lets go of a process' image
+ * Inputs: proc -- process whose address space is being torn down
+ * Outputs: none
+ * Return Value: none
+ * Function: The image stays cached once idle, so the next launch skips reading the file. Its
+ *           pages must already be unmapped, or about to be along with the page directory.
+ */
+void release_image(u8 const proc) {
+  u32 flags;
+
+  if (proc >= NUM_PROC)
+    return;
+
+  spin_lock_irqsave(&image_lock, flags);
+
+  if (task_image[proc] && !--task_image[proc]->users)
+    task_image[proc]->last_used = ++image_clock;
+
+  task_image[proc] = NULL;
+
+  spin_unlock_irqrestore(&image_lock, flags);
+}
+
+/* handle_page_fault
+ * Description: Fixes up a fault on a demand-paged or copy-on-write page
+ * Inputs: proc -- process that faulted
+ *         addr -- faulting address, from CR2
+ *         errc -- error code the CPU pushed (PF_*)
+ * Outputs: none
+ * Return Value: 0 if the access can be retried, -1 if it is a real fault
+ * Function: A page of the program window or the stack that isn't there yet gets a zeroed
+ *           frame from the pool, which is how the stack grows; a write to a page still shared
+ *           with the image cache gets a private copy. Kernel writes fault too, since CR0.WP is
+ *           set, so copying into a user buffer works the same.
+ */
+i32 handle_page_fault(u8 const proc, u32 const addr, u32 const errc) {
+  u32 const page = addr & ~(FRAME_SIZE - 1);
+  u32 pte, frame;
+
+  if (!is_demand_paged(addr))
+    return -1;
+
+  pte = get_user_pte(proc, page);
+
+  if ((pte & PG_PRESENT) && (!(errc & PF_WRITE) || !(pte & PG_COW)))
+    return -1;
+
+  if (!(pte & PG_PRESENT))
+    frame = alloc_zeroed_frame();
+  else if ((frame = alloc_frame()))
+    memcpy((void*)frame, (void const*)(pte & ~(FRAME_SIZE - 1)), FRAME_SIZE);
+
+  if (!frame)
+    return -1;
+
+  if (map_user_page(proc, page, frame, PG_RW)) {
+    frame_free(frame);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* is_demand_paged
+ * Description: Checks whether an address is filled in on first touch
+ * Inputs: addr -- user address
+ * Outputs: none
+ * Return Value: 1 if it is in the program window or the stack, 0 otherwise
+ * Function: The stack may grow down to STACK_LIMIT. The page below it is never mapped, so
+ *           running off the end of the stack faults instead of reaching other memory.
+ */
+i32 is_demand_paged(u32 const addr) {
+  return (addr >= ELF_WINDOW_START && addr < ELF_WINDOW_END) ||
+         (addr >= STACK_LIMIT && addr < STACK_WINDOW_END);
+}
+
+/* alloc_zeroed_frame
+ * Description: Gets a zero-filled frame for a user page
+ * Inputs: none
+ * Outputs: none
+ * Return Value: physical address of the frame, 0 if memory is full
+ * Function: Comes from the pool when it has one, so the caller doesn't wait for 4KB to be
+ *           cleared; otherwise it is zeroed here
+ */
+u32 alloc_zeroed_frame(void) {
+  u32 frame = zero_pool_take();
+
+  if (!frame && (frame = alloc_frame()))
+    memset((void*)frame, 0, FRAME_SIZE);
+
+  return frame;
+}
+
+/* zero_pool_refill
+ * Description: Tops up the pool of zeroed frames by a batch
+ * Inputs: none
+ * Outputs: none
+ * Return Value: number of frames added, 0 once the pool is full or memory is getting short
+ * Function: Called by the scheduler when nothing can run. Works a batch at a time so the caller
+ *           can take interrupts in between, and leaves ZERO_POOL_RESERVE frames for everything
+ *           else. The frames are zeroed with the lock dropped.
+ */
+u32 zero_pool_refill(void) {
+  u32 flags, frame, added;
+
+  for (added = 0; added < ZERO_POOL_BATCH; ++added) {
+    if (zero_pool_count() >= ZERO_POOL_SIZE || frames_free() <= ZERO_POOL_RESERVE)
+      break;
+
+    if (!(frame = frame_alloc()))
+      break;
+
+    memset((void*)frame, 0, FRAME_SIZE);
+
+    spin_lock_irqsave(&zero_pool_lock, flags);
+
+    if (zero_pool_cnt < ZERO_POOL_SIZE) {
+      zero_pool[zero_pool_cnt++] = frame;
+      frame = 0;
+    }
+
+    spin_unlock_irqrestore(&zero_pool_lock, flags);
+
+    /* Someone else filled it first */
+    if (frame) {
+      frame_free(frame);
+      break;
+    }
+  }
+
+  return added;
+}
+
+/* zero_pool_count
+ * Description: Gets how many zeroed frames are waiting in the pool
+ * Inputs: none
+ * Outputs: none
+ * Return Value: frames in the pool
+ * Function: Getter
+ */
+u32 zero_pool_count(void) { return zero_pool_cnt; }
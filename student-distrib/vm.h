@@ -0,0 +1,41 @@
+#ifndef VM_H
+#define VM_H
+
+#include "paging.h"
+#include "spinlock.h"
+#include "types.h"
+
+enum {
+  MAX_IMAGES = 16, /* More than NUM_PROC, so there is always an idle or free entry to load into */
+  PF_PRESENT = 1,  /* Page fault error code: the page was present (protection fault) */
+  PF_WRITE = 1 << 1,
+  PF_USER = 1 << 2,
+  ELF_WINDOW_START = ELF_LOAD_PG * PG_4M_START,
+  ELF_WINDOW_END = ELF_WINDOW_START + PG_4M_START,
+  STACK_WINDOW_START = STACK_PG * PG_4M_START,
+  STACK_WINDOW_END = STACK_WINDOW_START + PG_4M_START,
+  STACK_LIMIT = STACK_WINDOW_START + PTE_SIZE, /* Lowest stack page; the one below is a guard */
+  ZERO_POOL_SIZE = 64,    /* Pre-zeroed frames kept for the page fault path */
+  ZERO_POOL_BATCH = 4,    /* Frames zeroed per idle pass, between chances to take interrupts */
+  ZERO_POOL_RESERVE = 256 /* Free frames the pool never dips below when filling */
+};
+
+/* A program file read into frames once and mapped copy-on-write by every process running it */
+typedef struct Image {
+  u32* frames; /* One per page of the file, from kmalloc; NULL if the entry is free */
+  u32 inode;
+  u32 npages;
+  u32 users;     /* Processes with it mapped; idle images stay cached until they are evicted */
+  u32 last_used; /* image_clock when it last went idle, for picking which to evict */
+} Image;
+
+void init_vm(void);
+i32 map_image(u8 proc, u32 inode);
+void release_image(u8 proc);
+i32 handle_page_fault(u8 proc, u32 addr, u32 errc);
+i32 is_demand_paged(u32 addr);
+u32 alloc_zeroed_frame(void);
+u32 zero_pool_refill(void);
+u32 zero_pool_count(void);
+
+#endif
@@ -0,0 +1,86 @@
+#include "wait.h"
+#include "lib.h"
+#include "pit.h"
+#include "syscall.h"
+
+/* init_wait_queue
+ * Description: Prepares a wait queue for use
+ * Inputs: wq -- queue to initialize
+ * Outputs: none
+ * Return Value: none
+ * Function: Empties the queue
+ */
+void init_wait_queue(WaitQueue* const wq) { wq->waiters = 0; }
+
+/* wait_on
+ * Description: Blocks the current task until the queue is woken
+ * Inputs: wq -- queue to wait on
+ * Outputs: none
+ * Return Value: none
+ * Function: Must be called with interrupts off, right after checking the condition being waited
+ *           for, so a wake_up from an interrupt handler can't slip in between. Signals and timers
+ *           can also wake the task, so callers re-check their condition in a loop.
+ */
+void wait_on(WaitQueue* const wq) {
+  Pcb* const pcb = get_current_pcb();
+  u32 const bit = 1U << pcb->pid;
+
+  wq->waiters |= bit;
+  pcb->state = TASK_INTERRUPTIBLE;
+
+  block_current();
+
+  wq->waiters &= ~bit;
+}
+
+/* wake_up
+ * Description: Wakes every task waiting on a queue
+ * Inputs: wq -- queue to wake
+ * Outputs: none
+ * Return Value: none
+ * Function: Safe to call from interrupt handlers
+ */
+void wake_up(WaitQueue* const wq) {
+  u32 waiters = wq->waiters;
+  u32 pid;
+
+  wq->waiters = 0;
+
+  for (pid = 0; waiters; ++pid, waiters >>= 1)
+    if ((waiters & 1) && get_pcb(pid)->state == TASK_INTERRUPTIBLE)
+      wake_task(pid);
+}
+
+/* poll_wait
+ * Description: Registers the current task on a queue for a poll call
+ * Inputs: wq -- queue a descriptor's readiness depends on
+ *         pt -- poll call's table, or NULL if the caller won't block
+ * Outputs: none
+ * Return Value: none
+ * Function: Called by FileOps poll callbacks. The task stays registered until
+ *           poll_table_release, so any one of its descriptors becoming ready wakes it.
+ */
+void poll_wait(WaitQueue* const wq, PollTable* const pt) {
+  if (!wq || !pt || pt->cnt >= POLL_TABLE_SIZE)
+    return;
+
+  wq->waiters |= 1U << get_current_pcb()->pid;
+  pt->queues[pt->cnt++] = wq;
+}
+
+/* poll_table_release
+ * Description: Takes the current task off every queue a poll call registered on
+ * Inputs: pt -- poll call's table
+ * Outputs: none
+ * Return Value: none
+ * Function: Keeps a later, unrelated sleep from being woken by a stale registration
+ */
+void poll_table_release(PollTable* const pt) {
+  u32 const bit = 1U << get_current_pcb()->pid;
+  u32 i;
+
+  for (i = 0; i < pt->cnt; ++i)
+    pt->queues[i]->waiters &= ~bit;
+
+  pt->cnt = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef WAIT_H
+#define WAIT_H
+
+#include "types.h"
+
+enum {
+  POLL_TABLE_SIZE = 8 /* One queue per descriptor a process can have open */
+};
+
+/* Tasks blocked until some event happens, one bit per pid */
+typedef struct WaitQueue {
+  u32 waiters;
+} WaitQueue;
+
+/* Queues a poll call registered on, so it can leave them all once it wakes */
+typedef struct PollTable {
+  WaitQueue* queues[POLL_TABLE_SIZE];
+  u32 cnt;
+} PollTable;
+
+void init_wait_queue(WaitQueue* wq);
+void wait_on(WaitQueue* wq);
+void wake_up(WaitQueue* wq);
+void poll_wait(WaitQueue* wq, PollTable* pt);
+void poll_table_release(PollTable* pt);
+
+#endif
@@ -6,6 +6,7 @@
 #ifndef _X86_DESC_H
 #define _X86_DESC_H
 
+#include "paging.h"
 #include "types.h"
 
 /* Segment selector values */
@@ -16,6 +17,9 @@
 #define KERNEL_TSS 0x0030
 #define KERNEL_LDT 0x0038
 
+/* Initial user stack pointer: top of the stack window (STACK_PG), right above vidmap */
+#define USER_STACK_TOP (((STACK_PG_MCR + 1) << 22) - 4)
+
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE 104
 
@@ -24,8 +28,6 @@
 
 #ifndef ASM
 
-#include "paging.h"
-
 /* This structure is used to load descriptor base registers
  * like the GDTR and IDTR */
 typedef struct x86_desc {
@@ -122,13 +124,16 @@ extern seg_desc_t ldt_desc_ptr;
 extern seg_desc_t gdt_ptr;
 extern u32 ldt;
 
+extern seg_desc_t gdt[];
+
 extern u32 tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
 
-extern u32 pgdir[8][PGDIR_LEN];
+/* The kernel's page directory, and the table for its low 4MB; processes get their own from the
+ * frame allocator (see paging.c) */
+extern u32 pgdir[PGDIR_LEN];
 extern u32 pgtbl[PGTBL_LEN];
-extern u32 pgtbl_proc[8][PGTBL_LEN];
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                                                             \
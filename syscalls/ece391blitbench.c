@@ -0,0 +1,71 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+#define SCREEN_BYTES (80 * 25 * 2)
+#define SCREEN_WORDS (SCREEN_BYTES / 4)
+#define FRAMES 2000
+#define ATTRIB 0x07
+
+static void put_num(const char* label, uint32_t value);
+
+/* Print "label<value>\n" */
+static void put_num(const char* label, uint32_t value) {
+  uint8_t buf[BUFSIZE];
+
+  ece391_fdputs(1, (uint8_t*)label);
+  ece391_fdputs(1, ece391_itoa(value, buf, 10));
+  ece391_fdputs(1, (uint8_t*)"\n");
+}
+
+/*
+ * Copy whole screens into the vidmap'd text memory, the way a full-screen
+ * redraw does, and report how long each one takes. Run it with the kernel
+ * built with VIDMEM_WC on and off to compare write-combining against
+ * uncached video memory. The screen is put back afterwards.
+ */
+int main() {
+  static uint32_t saved[SCREEN_WORDS], frame[SCREEN_WORDS];
+  struct ece391_timespec start, end;
+  uint32_t* screen;
+  uint32_t i, j, us, ns, bytes = FRAMES * SCREEN_BYTES;
+
+  if (-1 == ece391_vidmap((uint8_t**)&screen)) {
+    ece391_fdputs(1, (uint8_t*)"vidmap failed\n");
+    return 3;
+  }
+
+  for (j = 0; j < SCREEN_WORDS; j++)
+    saved[j] = screen[j];
+
+  ece391_gettime(&start);
+  for (i = 0; i < FRAMES; i++) {
+    /* A different character every frame, so each one really is a new screen */
+    uint32_t const cell = ('!' + i % 94) | (ATTRIB << 8);
+
+    for (j = 0; j < SCREEN_WORDS; j++)
+      frame[j] = cell | (cell << 16);
+    for (j = 0; j < SCREEN_WORDS; j++)
+      screen[j] = frame[j];
+  }
+  ece391_gettime(&end);
+
+  for (j = 0; j < SCREEN_WORDS; j++)
+    screen[j] = saved[j];
+
+  if (end.nsec < start.nsec) {
+    end.nsec += 1000000000;
+    end.sec--;
+  }
+  us = (end.sec - start.sec) * 1000000 + (end.nsec - start.nsec) / 1000;
+  ns = (us / FRAMES) * 1000 + (us % FRAMES) * 1000 / FRAMES;
+
+  put_num("screens: ", FRAMES);
+  put_num("total us: ", us);
+  put_num("ns per screen: ", ns);
+  if (us)
+    put_num("KB/s: ", (bytes / us) * 1000 + (bytes % us) * 1000 / us);
+  return 0;
+}
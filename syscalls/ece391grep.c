@@ -6,20 +6,37 @@
 #define BUFSIZE 1024
 #define SBUFSIZE 33
 
-int32_t do_one_file(const char* s, const char* fname) {
-  int32_t fd, cnt, last, line_start, line_end, check, s_len;
-  uint8_t data[BUFSIZE + 1];
+/*
+ * Print the lines read from fd that contain s, prefixed with "fname:" unless
+ * fname is null. The buffer doubles whenever a line doesn't fit, so long
+ * lines are searched whole.
+ */
+int32_t grep_fd(const char* s, int32_t fd, const char* fname) {
+  int32_t cnt, last, line_start, line_end, check, s_len, size = BUFSIZE;
+  uint8_t* data = ece391_malloc(size + 1);
+  uint8_t* bigger;
 
-  s_len = ece391_strlen((uint8_t*)s);
-  if (-1 == (fd = ece391_open((uint8_t*)fname))) {
-    ece391_fdputs(1, (uint8_t*)"file open failed\n");
+  if (!data) {
+    ece391_fdputs(1, (uint8_t*)"out of memory\n");
     return -1;
   }
+
+  s_len = ece391_strlen((uint8_t*)s);
   last = 0;
   while (1) {
-    cnt = ece391_read(fd, data + last, BUFSIZE - last);
+    if (last == size) {
+      if (!(bigger = ece391_realloc(data, 2 * size + 1))) {
+        ece391_fdputs(1, (uint8_t*)"out of memory\n");
+        ece391_free(data);
+        return -1;
+      }
+      data = bigger;
+      size *= 2;
+    }
+    cnt = ece391_read(fd, data + last, size - last);
     if (-1 == cnt) {
       ece391_fdputs(1, (uint8_t*)"file read failed\n");
+      ece391_free(data);
       return -1;
     }
     last += cnt;
@@ -28,7 +45,7 @@ int32_t do_one_file(const char* s, const char* fname) {
       line_end = line_start;
       while (line_end < last && '\n' != data[line_end])
         line_end++;
-      if ('\n' != data[line_end] && 0 != cnt && line_start != 0) {
+      if (line_end == last && 0 != cnt) {
         /* copy from line_start to last down to 0 and fix last */
         data[line_end] = '\0';
         ece391_strcpy(data, data + line_start);
@@ -40,8 +57,10 @@ int32_t do_one_file(const char* s, const char* fname) {
       for (check = line_start; check < line_end; check++) {
         if (s[0] == data[check] &&
             0 == ece391_strncmp((uint8_t*)(data + check), (uint8_t*)s, s_len)) {
-          ece391_fdputs(1, (uint8_t*)fname);
-          ece391_fdputs(1, (uint8_t*)":");
+          if (fname) {
+            ece391_fdputs(1, (uint8_t*)fname);
+            ece391_fdputs(1, (uint8_t*)":");
+          }
           ece391_fdputs(1, data + line_start);
           ece391_fdputs(1, (uint8_t*)"\n");
           break;
@@ -56,6 +75,19 @@ int32_t do_one_file(const char* s, const char* fname) {
     if (0 == cnt)
       break;
   }
+  ece391_free(data);
+  return 0;
+}
+
+int32_t do_one_file(const char* s, const char* fname) {
+  int32_t fd;
+
+  if (-1 == (fd = ece391_open((uint8_t*)fname))) {
+    ece391_fdputs(1, (uint8_t*)"file open failed\n");
+    return -1;
+  }
+  if (0 != grep_fd(s, fd, fname))
+    return -1;
   if (-1 == ece391_close(fd)) {
     ece391_fdputs(1, (uint8_t*)"file close failed\n");
     return -1;
@@ -73,6 +105,10 @@ int main() {
     return 3;
   }
 
+  /* At the end of a pipeline, search what the previous stage wrote instead of every file */
+  if (ece391_fcntl(0, F_GETFL, 0) & O_PIPE)
+    return (0 != grep_fd((char*)search, 0, 0)) ? 3 : 0;
+
   if (-1 == (fd = ece391_open((uint8_t*)"."))) {
     ece391_fdputs(1, (uint8_t*)"directory open failed\n");
     return 2;
@@ -4,6 +4,78 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define MAX_STAGES 4
+
+static int32_t run_pipeline(uint8_t* buf);
+static int32_t has_pipe(const uint8_t* buf);
+
+/*
+ * Run "cmd1 | cmd2 | ..." with each stage's stdout piped into the next
+ * stage's stdin. Returns the last stage's status, like execute would.
+ */
+static int32_t run_pipeline(uint8_t* buf) {
+  uint8_t* stages[MAX_STAGES];
+  int32_t pids[MAX_STAGES];
+  int32_t fds[2];
+  int32_t nstages, started, in, i, rval;
+  uint8_t* end;
+
+  /* Split on '|' and trim the spaces around each stage */
+  nstages = 0;
+  stages[nstages++] = buf;
+  for (; '\0' != *buf; buf++) {
+    if ('|' != *buf)
+      continue;
+    if (MAX_STAGES == nstages)
+      return -1;
+    *buf = '\0';
+    stages[nstages++] = buf + 1;
+  }
+  for (i = 0; i < nstages; i++) {
+    while (' ' == *stages[i])
+      stages[i]++;
+    end = stages[i] + ece391_strlen(stages[i]);
+    while (end > stages[i] && ' ' == end[-1])
+      *--end = '\0';
+    if ('\0' == *stages[i])
+      return -1;
+  }
+
+  in = 0;
+  started = 0;
+  for (i = 0; i < nstages; i++) {
+    fds[0] = 0;
+    fds[1] = 1;
+    if (i + 1 < nstages && -1 == ece391_pipe(fds))
+      break;
+    pids[i] = ece391_spawn(stages[i], in, fds[1]);
+    /* The children hold their own references to the pipe ends now */
+    if (0 != in)
+      ece391_close(in);
+    if (1 != fds[1])
+      ece391_close(fds[1]);
+    in = fds[0];
+    if (-1 == pids[i])
+      break;
+    started++;
+  }
+  if (0 != in)
+    ece391_close(in);
+
+  /* Every stage that started has to be collected, not just the last */
+  rval = -1;
+  for (i = 0; i < started; i++)
+    rval = ece391_wait(pids[i]);
+  return (started == nstages) ? rval : -1;
+}
+
+/* Whether a command line has a '|' in it */
+static int32_t has_pipe(const uint8_t* buf) {
+  for (; '\0' != *buf; buf++)
+    if ('|' == *buf)
+      return 1;
+  return 0;
+}
 
 int main() {
   int32_t cnt, rval;
@@ -23,7 +95,7 @@ int main() {
       return 0;
     if ('\0' == buf[0])
       continue;
-    rval = ece391_execute(buf);
+    rval = has_pipe(buf) ? run_pipeline(buf) : ece391_execute(buf);
     if (-1 == rval)
       ece391_fdputs(1, (uint8_t*)"no such command\n");
     else if (256 == rval)
@@ -3,6 +3,30 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
+#define MALLOC_HDR 8         /* Block header; keeps what malloc returns 8-byte aligned */
+#define MALLOC_MIN_SHIFT 4   /* Smallest block is 16 bytes, header included */
+#define MALLOC_CLASSES 8     /* Power-of-two blocks up to 2KB; bigger ones are whole pages */
+#define MALLOC_PAGE 4096
+#define ARENA_SIZE 0x10000   /* The heap is grown this much at a time */
+
+/* Every block starts with its size; next is only used while the block is free */
+struct malloc_block {
+  uint32_t size;
+  uint32_t unused;
+  struct malloc_block* next;
+};
+
+/* Freed blocks by size class, reused last-in first-out. A process has a single thread, so these
+ * need no locking. */
+static struct malloc_block* free_lists[MALLOC_CLASSES];
+/* Freed blocks bigger than the largest class, first fit */
+static struct malloc_block* free_large;
+/* Part of the heap no block has been carved from yet */
+static uint8_t* arena_cur;
+static uint8_t* arena_end;
+
+static void* arena_carve(uint32_t size);
+
 uint32_t ece391_strlen(const uint8_t* s) {
   uint32_t len;
 
@@ -95,3 +119,104 @@ uint8_t* ece391_strrev(uint8_t* s) {
   return s;
 }
 
+/* Take size bytes off the unused part of the heap, growing the heap if it is too small */
+static void* arena_carve(uint32_t size) {
+  uint8_t* p;
+  uint32_t grow;
+  int32_t base;
+
+  if ((uint32_t)(arena_end - arena_cur) < size) {
+    grow = (size + ARENA_SIZE - 1) & ~(ARENA_SIZE - 1);
+    if (-1 == (base = ece391_sbrk(grow)))
+      return 0;
+
+    /* Unless this is the first arena, the new one continues the last */
+    if ((uint8_t*)base != arena_end)
+      arena_cur = (uint8_t*)base;
+    arena_end = (uint8_t*)base + grow;
+  }
+
+  p = arena_cur;
+  arena_cur += size;
+  return p;
+}
+
+/* Allocate size bytes, 8-byte aligned; returns NULL if size is 0 or the heap is full */
+void* ece391_malloc(uint32_t size) {
+  struct malloc_block** prev;
+  struct malloc_block* b;
+  uint32_t cls;
+
+  if (0 == size || size > 0x7FFFFFFF - MALLOC_PAGE)
+    return 0;
+  size += MALLOC_HDR;
+
+  if (size <= (1U << (MALLOC_MIN_SHIFT + MALLOC_CLASSES - 1))) {
+    for (cls = 0; size > (1U << (MALLOC_MIN_SHIFT + cls)); cls++)
+      ;
+
+    if ((b = free_lists[cls]))
+      free_lists[cls] = b->next;
+    else if ((b = arena_carve(1U << (MALLOC_MIN_SHIFT + cls))))
+      b->size = 1U << (MALLOC_MIN_SHIFT + cls);
+  } else {
+    size = (size + MALLOC_PAGE - 1) & ~(MALLOC_PAGE - 1);
+
+    for (prev = &free_large; *prev && (*prev)->size < size; prev = &(*prev)->next)
+      ;
+
+    if ((b = *prev))
+      *prev = b->next;
+    else if ((b = arena_carve(size)))
+      b->size = size;
+  }
+
+  return b ? (uint8_t*)b + MALLOC_HDR : 0;
+}
+
+/* Free memory from ece391_malloc or ece391_realloc; NULL is ignored */
+void ece391_free(void* ptr) {
+  struct malloc_block* b;
+  uint32_t cls;
+
+  if (!ptr)
+    return;
+  b = (struct malloc_block*)((uint8_t*)ptr - MALLOC_HDR);
+
+  if (b->size > (1U << (MALLOC_MIN_SHIFT + MALLOC_CLASSES - 1))) {
+    b->next = free_large;
+    free_large = b;
+    return;
+  }
+
+  for (cls = 0; b->size > (1U << (MALLOC_MIN_SHIFT + cls)); cls++)
+    ;
+  b->next = free_lists[cls];
+  free_lists[cls] = b;
+}
+
+/* Resize an allocation, moving it if its block is too small; on failure the old one is kept */
+void* ece391_realloc(void* ptr, uint32_t size) {
+  struct malloc_block* b;
+  uint8_t* p;
+  uint32_t i;
+
+  if (!ptr)
+    return ece391_malloc(size);
+  if (0 == size) {
+    ece391_free(ptr);
+    return 0;
+  }
+
+  b = (struct malloc_block*)((uint8_t*)ptr - MALLOC_HDR);
+  if (size <= b->size - MALLOC_HDR)
+    return ptr;
+
+  if (!(p = ece391_malloc(size)))
+    return 0;
+  for (i = 0; i < b->size - MALLOC_HDR; i++)
+    p[i] = ((uint8_t*)ptr)[i];
+
+  ece391_free(ptr);
+  return p;
+}
@@ -0,0 +1,76 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+#define ROUNDS 1000
+#define SWITCHES (2 * ROUNDS)
+
+static void put_num(const char* label, uint32_t value);
+
+/* Print "label<value>\n" */
+static void put_num(const char* label, uint32_t value) {
+  uint8_t buf[BUFSIZE];
+
+  ece391_fdputs(1, (uint8_t*)label);
+  ece391_fdputs(1, ece391_itoa(value, buf, 10));
+  ece391_fdputs(1, (uint8_t*)"\n");
+}
+
+/*
+ * Ping-pong a byte between two processes over a pair of pipes. Every round
+ * trip blocks each side once, so it costs two context switches.
+ * "switchbench child" is the echoing side, spawned by the parent.
+ */
+int main() {
+  uint8_t buf[BUFSIZE];
+  int32_t to_child[2], to_parent[2];
+  struct ece391_timespec start, end;
+  uint32_t i, us;
+  int32_t pid;
+
+  if (0 == ece391_getargs(buf, BUFSIZE) && 0 == ece391_strcmp(buf, (uint8_t*)"child")) {
+    while (1 == ece391_read(0, buf, 1))
+      if (1 != ece391_write(1, buf, 1))
+        return 1;
+    return 0;
+  }
+
+  if (-1 == ece391_pipe(to_child) || -1 == ece391_pipe(to_parent)) {
+    ece391_fdputs(1, (uint8_t*)"could not create pipes\n");
+    return 3;
+  }
+  if (-1 == (pid = ece391_spawn((uint8_t*)"switchbench child", to_child[0], to_parent[1]))) {
+    ece391_fdputs(1, (uint8_t*)"could not spawn child\n");
+    return 3;
+  }
+  ece391_close(to_child[0]);
+  ece391_close(to_parent[1]);
+
+  buf[0] = 'x';
+  ece391_gettime(&start);
+  for (i = 0; i < ROUNDS; i++) {
+    if (1 != ece391_write(to_child[1], buf, 1) || 1 != ece391_read(to_parent[0], buf, 1)) {
+      ece391_fdputs(1, (uint8_t*)"ping-pong failed\n");
+      return 3;
+    }
+  }
+  ece391_gettime(&end);
+
+  /* Closing our write end makes the child see end-of-file and exit */
+  ece391_close(to_child[1]);
+  ece391_wait(pid);
+  ece391_close(to_parent[0]);
+
+  if (end.nsec < start.nsec) {
+    end.nsec += 1000000000;
+    end.sec--;
+  }
+  us = (end.sec - start.sec) * 1000000 + (end.nsec - start.nsec) / 1000;
+
+  put_num("round trips: ", ROUNDS);
+  put_num("total us: ", us);
+  put_num("ns per switch: ", (us / SWITCHES) * 1000 + (us % SWITCHES) * 1000 / SWITCHES);
+  return 0;
+}
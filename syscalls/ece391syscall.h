@@ -21,8 +21,89 @@ extern int32_t ece391_getargs(uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap(uint8_t** screen_start);
 extern int32_t ece391_set_handler(int32_t signum, void* handler);
 extern int32_t ece391_sigreturn(void);
+extern int32_t ece391_sleep(uint32_t ms);
+extern int32_t ece391_yield(void);
+
+/* Wait for any of nfds descriptors to become ready; timeout_ms < 0 waits forever */
+struct ece391_pollfd {
+  int32_t fd;
+  uint16_t events;
+  uint16_t revents;
+};
+extern int32_t ece391_poll(struct ece391_pollfd* fds, uint32_t nfds, int32_t timeout_ms);
+
+/*
+ * With O_NONBLOCK set, a terminal read returns 0 when no full line has been
+ * typed yet and an RTC read returns -1 when no tick is pending.
+ */
+extern int32_t ece391_fcntl(int32_t fd, uint32_t cmd, uint32_t arg);
+
+/*
+ * shm_create returns the id of the segment named by key, creating it
+ * (zero-filled) if needed. shm_attach maps it and stores its address, which
+ * is the same in every process. Segments go away once every process that
+ * created or attached them has halted.
+ */
+extern int32_t ece391_shm_create(uint32_t key, uint32_t size);
+extern int32_t ece391_shm_attach(int32_t id, uint8_t** addr);
+
+/*
+ * pipe stores a read end in fds[0] and a write end in fds[1]. Reads return 0
+ * once every write end is closed.
+ * spawn starts a command alongside the caller with fd_in/fd_out as its
+ * stdin/stdout and returns its pid; wait collects its exit status.
+ */
+extern int32_t ece391_pipe(int32_t fds[2]);
+extern int32_t ece391_spawn(const uint8_t* command, int32_t fd_in, int32_t fd_out);
+extern int32_t ece391_wait(int32_t pid);
+
+/*
+ * Add inc to the caller's niceness and return the new value (0 to 3).
+ * A nice process never runs at a priority above its niceness; children
+ * inherit it.
+ */
+extern int32_t ece391_nice(int32_t inc);
+
+/* Monotonic time since boot, with nanosecond resolution */
+struct ece391_timespec {
+  uint32_t sec;
+  uint32_t nsec;
+};
+extern int32_t ece391_gettime(struct ece391_timespec* ts);
+
+/*
+ * Fill in up to n entries, one per process, and return how many were filled.
+ * Times are microseconds modulo 2^32, so only differences between two
+ * snapshots are meaningful.
+ */
+struct ece391_procstat {
+  uint32_t pid;
+  int32_t parent_pid;
+  uint8_t state;
+  uint8_t term;
+  uint8_t prio;
+  uint8_t nice;
+  uint32_t utime_us;
+  uint32_t stime_us;
+  uint32_t nr_switches;
+  uint32_t nr_syscalls;
+  char name[32];
+};
+extern int32_t ece391_getprocs(struct ece391_procstat* buf, int32_t n);
+
+/*
+ * Move the end of the heap by inc bytes and return its old address, or -1
+ * if it would leave the heap's 24MB window or memory is full. New pages read
+ * as zero. Most programs want ece391_malloc instead.
+ */
+extern int32_t ece391_sbrk(int32_t inc);
 
 enum signums { DIV_ZERO = 0, SEGFAULT, INTERRUPT, ALARM, USER1, NUM_SIGNALS };
 
+enum pollevents { POLLIN = 1, POLLOUT = 4, POLLNVAL = 32 };
+
+enum fcntlcmds { F_GETFL = 1, F_SETFL };
+enum fdflags { O_NONBLOCK = 2, O_PIPE = 4 };
+
 #endif /* ECE391SYSCALL_H */
 
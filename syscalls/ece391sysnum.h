@@ -11,5 +11,18 @@
 #define SYS_VIDMAP 8
 #define SYS_SET_HANDLER 9
 #define SYS_SIGRETURN 10
+#define SYS_SLEEP 11
+#define SYS_YIELD 12
+#define SYS_POLL 13
+#define SYS_FCNTL 14
+#define SYS_SHM_CREATE 15
+#define SYS_SHM_ATTACH 16
+#define SYS_PIPE 17
+#define SYS_SPAWN 18
+#define SYS_WAIT 19
+#define SYS_NICE 20
+#define SYS_GETTIME 21
+#define SYS_GETPROCS 22
+#define SYS_SBRK 23
 
 #endif /* ECE391SYSNUM_H */
@@ -0,0 +1,149 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+#define MAX_PROCS 8
+#define DEFAULT_HZ 2
+#define MAX_HZ 1024
+#define NAME_WIDTH 12
+
+static void put_col(const uint8_t* s, uint32_t width);
+static void put_num_col(uint32_t value, uint32_t width);
+static uint32_t parse_hz(const uint8_t* s);
+static uint32_t elapsed_us(const struct ece391_timespec* from, const struct ece391_timespec* to);
+static const struct ece391_procstat* find_prev(const struct ece391_procstat* prev, int32_t cnt,
+                                               const struct ece391_procstat* cur);
+
+/* Print s right-aligned in a column width characters wide, plus a separating space */
+static void put_col(const uint8_t* s, uint32_t width) {
+  uint32_t len = ece391_strlen(s);
+
+  while (len++ < width)
+    ece391_fdputs(1, (uint8_t*)" ");
+  ece391_fdputs(1, s);
+  ece391_fdputs(1, (uint8_t*)" ");
+}
+
+/* Same, for a number */
+static void put_num_col(uint32_t value, uint32_t width) {
+  uint8_t buf[BUFSIZE];
+
+  put_col(ece391_itoa(value, buf, 10), width);
+}
+
+/* Refresh rate from the arguments: a power of two the RTC can do, DEFAULT_HZ if missing or bad */
+static uint32_t parse_hz(const uint8_t* s) {
+  uint32_t hz = 0;
+
+  for (; *s >= '0' && *s <= '9'; s++)
+    hz = hz * 10 + (*s - '0');
+
+  if (hz < 2 || hz > MAX_HZ || (hz & (hz - 1)))
+    return DEFAULT_HZ;
+  return hz;
+}
+
+/* Microseconds from one timestamp to a later one */
+static uint32_t elapsed_us(const struct ece391_timespec* from, const struct ece391_timespec* to) {
+  return (to->sec - from->sec) * 1000000 + to->nsec / 1000 - from->nsec / 1000;
+}
+
+/* The same process in the previous snapshot, or NULL if it is new (or its pid was reused) */
+static const struct ece391_procstat* find_prev(const struct ece391_procstat* prev, int32_t cnt,
+                                               const struct ece391_procstat* cur) {
+  int32_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (prev[i].pid == cur->pid && prev[i].nr_syscalls <= cur->nr_syscalls &&
+        0 == ece391_strcmp((uint8_t*)prev[i].name, (uint8_t*)cur->name))
+      return &prev[i];
+
+  return 0;
+}
+
+/*
+ * Show every process' share of the CPU, context switches and system calls,
+ * refreshed on each RTC interrupt. "top <hz>" sets the refresh rate; typing
+ * a line that starts with 'q' quits.
+ */
+int main() {
+  static const char states[] = "-RSDTZ";
+  struct ece391_procstat snap[2][MAX_PROCS];
+  struct ece391_timespec then, now;
+  int32_t rtc_fd, cnt[2] = {0, 0}, cur = 0, i, oldfl;
+  uint32_t hz = DEFAULT_HZ, wall, cpu;
+  uint8_t buf[BUFSIZE], state[2] = {0, 0};
+
+  if (0 == ece391_getargs(buf, BUFSIZE))
+    hz = parse_hz(buf);
+
+  if (-1 == (rtc_fd = ece391_open((uint8_t*)"rtc")) || 4 != ece391_write(rtc_fd, &hz, 4)) {
+    ece391_fdputs(1, (uint8_t*)"could not set up the rtc\n");
+    return 3;
+  }
+
+  /* Keep refreshing while watching for a 'q' line */
+  oldfl = ece391_fcntl(0, F_GETFL, 0);
+  ece391_fcntl(0, F_SETFL, oldfl | O_NONBLOCK);
+
+  ece391_gettime(&then);
+  cnt[cur] = ece391_getprocs(snap[cur], MAX_PROCS);
+
+  while (1) {
+    if (-1 == ece391_read(rtc_fd, buf, 4))
+      break;
+
+    i = ece391_read(0, buf, BUFSIZE - 1);
+    if (i > 0 && buf[0] == 'q')
+      break;
+
+    cur ^= 1;
+    ece391_gettime(&now);
+    if (-1 == (cnt[cur] = ece391_getprocs(snap[cur], MAX_PROCS)))
+      break;
+
+    wall = elapsed_us(&then, &now);
+    then = now;
+    if (!wall)
+      wall = 1;
+
+    ece391_fdputs(1, (uint8_t*)"\n PID PPID TTY PRI S  %CPU  USERms   SYSms "
+                               " SWITCHES  SYSCALLS NAME\n");
+
+    for (i = 0; i < cnt[cur]; i++) {
+      const struct ece391_procstat* p = &snap[cur][i];
+      const struct ece391_procstat* q = find_prev(snap[cur ^ 1], cnt[cur ^ 1], p);
+
+      cpu = p->utime_us + p->stime_us;
+      if (q)
+        cpu -= q->utime_us + q->stime_us;
+
+      put_num_col(p->pid, 4);
+      if (p->parent_pid < 0)
+        put_col((uint8_t*)"-", 4);
+      else
+        put_num_col(p->parent_pid, 4);
+      put_num_col(p->term, 3);
+      put_num_col(p->prio, 3);
+      state[0] = p->state < sizeof(states) - 1 ? states[p->state] : '?';
+      put_col(state, 1);
+      put_num_col(cpu >= wall ? 100 : cpu * 100 / wall, 5);
+      put_num_col(p->utime_us / 1000, 7);
+      put_num_col(p->stime_us / 1000, 7);
+      put_num_col(p->nr_switches, 9);
+      put_num_col(p->nr_syscalls, 9);
+
+      /* Keep each process on one line */
+      ece391_strcpy(buf, (uint8_t*)p->name);
+      buf[NAME_WIDTH] = '\0';
+      ece391_fdputs(1, buf);
+      ece391_fdputs(1, (uint8_t*)"\n");
+    }
+  }
+
+  ece391_fcntl(0, F_SETFL, oldfl);
+  ece391_close(rtc_fd);
+  return 0;
+}